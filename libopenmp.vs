@@ -4,6 +4,8 @@ LIBOPENMP_1.0 {
     ompt_lookup;
     __omp_collector_api;
     __ompc_barrier;
+    __ompc_barrier_arrive;
+    __ompc_barrier_wait_phase;
     __ompc_can_fork;
     __ompc_copyin_thdprv;
     __ompc_copyprivate;
@@ -17,6 +19,7 @@ LIBOPENMP_1.0 {
     __ompc_fini_rtl;
     __ompc_flush;
     __ompc_fork;
+    __ompc_fuzzy_barrier;
     __ompc_get_local_thread_num;
     __ompc_get_num_threads;
     __ompc_get_thdprv;
@@ -41,6 +44,7 @@ LIBOPENMP_1.0 {
     __ompc_cur_numthreads;
     __ompc_reduction;
     __ompc_end_reduction;
+    __ompc_tree_reduction;
     __ompc_ebarrier;
     __ompc_task_create;
     __ompc_task_wait;
@@ -75,6 +79,10 @@ LIBOPENMP_1.0 {
     omp_init_lock_;
     omp_init_nest_lock;
     omp_init_nest_lock_;
+    omp_init_lock_with_hint;
+    omp_init_lock_with_hint_;
+    omp_init_nest_lock_with_hint;
+    omp_init_nest_lock_with_hint_;
     omp_in_parallel;
     omp_in_parallel_;
     omp_set_dynamic;
@@ -0,0 +1,233 @@
+/*
+ Barrier microbenchmark for OpenUH's OpenMP runtime library
+
+ Copyright (C) 2014 University of Houston.
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of version 2 of the GNU General Public License as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it would be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+ Further, this software is distributed without any warranty that it is
+ free of the rightful claim of any third person regarding infringement
+ or the like.  Any license provided herein, whether implied or
+ otherwise, applies only to this software file.  Patent licenses, if
+ any, provided herein do not apply to combinations of this program with
+ other software, or any other product whatsoever.
+
+ You should have received a copy of the GNU General Public License along
+ with this program; if not, write the Free Software Foundation, Inc., 59
+ Temple Place - Suite 330, Boston MA 02111-1307, USA.
+
+ Contact information:
+ http://www.cs.uh.edu/~hpctools
+*/
+
+/*
+ * File: omp_barrier_bench.c
+ * Abstract: times the barriers and the fork/join of the library.
+ *
+ * The xbarrier algorithm and the affinity are fixed when the RTL starts,
+ * so the program runs itself once per O64_OMP_XBARRIER_TYPE and
+ * O64_OMP_SET_AFFINITY setting; each run sweeps the team sizes 1, 2, 4,
+ * ... up to the maximum. For every point, the master times each barrier
+ * (__ompc_ebarrier, which runs the selected __ompc_xbarrier_*_wait) and
+ * each empty parallel region (fork, then __ompc_level_1_barrier or the
+ * xbarrier join), and one CSV line reports the mean and tail latencies:
+ *
+ *   type,affinity,threads,what,samples,mean_ns,p50_ns,p90_ns,p99_ns,max_ns
+ *
+ * Usage: omp_barrier_bench [-t max_threads] [-n samples] [-x types]
+ *   types is a comma separated list, all algorithms by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "omp_rtl_api.h"
+
+#define BENCH_SAMPLES_DEFAULT	10000
+#define BENCH_WARMUP		100
+/* set in the environment of the runs of a single configuration */
+#define BENCH_CHILD_ENV		"OMP_BARRIER_BENCH_CHILD"
+
+static const char *bench_types_default =
+  "linear,simple,tour,tree,dissem,hier";
+
+static long int *bench_samples;
+static int bench_num_samples;
+
+static inline long int
+bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+  long int x = *(const long int *) a, y = *(const long int *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Sort the samples and print one CSV line for them */
+static void
+bench_report(const char *what, int threads)
+{
+  long int sum = 0;
+  int i, n = bench_num_samples;
+
+  qsort(bench_samples, n, sizeof(long int), bench_compare);
+  for (i = 0; i < n; i++)
+    sum += bench_samples[i];
+
+  printf("%s,%s,%d,%s,%d,%ld,%ld,%ld,%ld,%ld\n",
+         getenv("O64_OMP_XBARRIER_TYPE"), getenv("O64_OMP_SET_AFFINITY"),
+         threads, what, n, sum / n,
+         bench_samples[n / 2], bench_samples[(long) n * 90 / 100],
+         bench_samples[(long) n * 99 / 100], bench_samples[n - 1]);
+  fflush(stdout);
+}
+
+static void
+bench_barrier_micro(omp_int32 vthread_id, frame_pointer_t frame_pointer)
+{
+  long int start;
+  int i;
+
+  for (i = 0; i < BENCH_WARMUP; i++)
+    __ompc_ebarrier();
+
+  for (i = 0; i < bench_num_samples; i++) {
+    start = bench_now();
+    __ompc_ebarrier();
+    if (vthread_id == 0)
+      bench_samples[i] = bench_now() - start;
+  }
+}
+
+static void
+bench_empty_micro(omp_int32 vthread_id, frame_pointer_t frame_pointer)
+{
+}
+
+/* One configuration: the algorithm and affinity come from the
+ * environment, sweep the team sizes */
+static void
+bench_run(int max_threads)
+{
+  long int start;
+  int threads, i;
+
+  for (threads = 1; ; threads = threads * 2 > max_threads &&
+                                threads < max_threads ?
+                                max_threads : threads * 2) {
+    if (threads > max_threads)
+      break;
+
+    __ompc_fork(threads, bench_barrier_micro, NULL);
+    bench_report("barrier", threads);
+
+    for (i = 0; i < BENCH_WARMUP; i++)
+      __ompc_fork(threads, bench_empty_micro, NULL);
+    for (i = 0; i < bench_num_samples; i++) {
+      start = bench_now();
+      __ompc_fork(threads, bench_empty_micro, NULL);
+      bench_samples[i] = bench_now() - start;
+    }
+    bench_report("fork_join", threads);
+
+    if (threads == max_threads)
+      break;
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  static const char *affinities[] = { "true", "false" };
+  const char *list = bench_types_default;
+  char *types, *type, *saveptr;
+  int max_threads, opt, i, status;
+  pid_t pid;
+
+  max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  bench_num_samples = BENCH_SAMPLES_DEFAULT;
+
+  while ((opt = getopt(argc, argv, "t:n:x:")) != -1) {
+    switch (opt) {
+      case 't':
+        max_threads = atoi(optarg);
+        break;
+      case 'n':
+        bench_num_samples = atoi(optarg);
+        break;
+      case 'x':
+        list = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-t max_threads] [-n samples] "
+                "[-x type,...]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (max_threads < 1 || bench_num_samples < 1) {
+    fprintf(stderr, "%s: the thread and sample counts must be positive\n",
+            argv[0]);
+    return 1;
+  }
+
+  bench_samples = (long int *) malloc(sizeof(long int) * bench_num_samples);
+  if (bench_samples == NULL) {
+    fprintf(stderr, "%s: cannot allocate the samples\n", argv[0]);
+    return 1;
+  }
+
+  if (getenv(BENCH_CHILD_ENV) != NULL) {
+    bench_run(max_threads);
+    return 0;
+  }
+
+  printf("type,affinity,threads,what,samples,"
+         "mean_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+  fflush(stdout);
+
+  for (i = 0; i < sizeof(affinities) / sizeof(affinities[0]); i++) {
+    /* strtok_r takes the list apart, so each pass gets a fresh copy */
+    types = strdup(list);
+    for (type = strtok_r(types, ",", &saveptr); type != NULL;
+         type = strtok_r(NULL, ",", &saveptr)) {
+      pid = fork();
+      if (pid < 0) {
+        perror("fork");
+        return 1;
+      }
+      if (pid == 0) {
+        setenv(BENCH_CHILD_ENV, "1", 1);
+        setenv("O64_OMP_XBARRIER_TYPE", type, 1);
+        setenv("O64_OMP_SET_AFFINITY", affinities[i], 1);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        _exit(1);
+      }
+      if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+          WEXITSTATUS(status) != 0)
+        fprintf(stderr, "%s: the run of %s, affinity %s failed\n",
+                argv[0], type, affinities[i]);
+    }
+    free(types);
+  }
+
+  return 0;
+}
@@ -174,8 +174,7 @@ omp_init_lock(volatile omp_lock_t *lock)
   tmp_lp = aligned_malloc(sizeof(ompc_lock_t), CACHE_LINE_SIZE);
   Is_True(tmp_lp != NULL, "can not allocate tmp_lp");
 
-  tmp_lp->flag = __omp_spin_user_lock;
-  __ompc_init_lock(tmp_lp);
+  __ompc_init_user_lock(tmp_lp);
   (*lock) = (omp_lock_t)tmp_lp;
 
 #ifdef OMPT
@@ -207,6 +206,66 @@ omp_init_nest_lock(volatile omp_nest_lock_t *lock)
 void omp_init_nest_lock_(volatile omp_nest_lock_t *);
 #pragma weak omp_init_nest_lock_ = omp_init_nest_lock
 
+/* Uncontended locks get a test-and-set word, contended ones an MCS
+ * queue. There is no speculative engine, so the speculation hints are
+ * ignored, as is a hint that claims both kinds of contention. */
+static ompc_lock_kind_t
+__ompc_lock_kind_of_hint(omp_lock_hint_t hint)
+{
+  int contention = hint & (omp_lock_hint_uncontended |
+                           omp_lock_hint_contended);
+
+  if (contention == omp_lock_hint_uncontended)
+    return OMPC_LOCK_TAS;
+  if (contention == omp_lock_hint_contended)
+    return OMPC_LOCK_QUEUE;
+  return (ompc_lock_kind_t) __omp_spin_user_lock;
+}
+
+void
+omp_init_lock_with_hint(volatile omp_lock_t *lock, omp_lock_hint_t hint)
+{
+  ompc_lock_t *tmp_lp;
+  tmp_lp = aligned_malloc(sizeof(ompc_lock_t), CACHE_LINE_SIZE);
+  Is_True(tmp_lp != NULL, "can not allocate tmp_lp");
+
+  __ompc_init_lock_kind(tmp_lp, __ompc_lock_kind_of_hint(hint));
+  (*lock) = (omp_lock_t)tmp_lp;
+
+#ifdef OMPT
+  __ompc_get_current_v_thread()->wait_id = (ompt_wait_id_t) lock;
+  __ompc_ompt_event_callback(0, ompt_event_init_lock);
+#endif
+}
+
+void
+omp_init_lock_with_hint_(volatile omp_lock_t *lock, omp_lock_hint_t *hint)
+{
+  omp_init_lock_with_hint(lock, *hint);
+}
+
+void
+omp_init_nest_lock_with_hint(volatile omp_nest_lock_t *lock,
+                             omp_lock_hint_t hint)
+{
+  ompc_nest_lock_t * tmp_lp;
+  tmp_lp = aligned_malloc(sizeof(ompc_nest_lock_t), CACHE_LINE_SIZE); 
+  Is_True(tmp_lp != NULL, "can not allocate tmp_lp");
+  __ompc_init_nest_lock_kind(tmp_lp, __ompc_lock_kind_of_hint(hint));
+  (*lock) = (omp_nest_lock_t)tmp_lp; 
+#ifdef OMPT
+  __ompc_get_current_v_thread()->wait_id = (ompt_wait_id_t) lock;
+  __ompc_ompt_event_callback(0, ompt_event_init_nest_lock);
+#endif
+}
+
+void
+omp_init_nest_lock_with_hint_(volatile omp_nest_lock_t *lock,
+                              omp_lock_hint_t *hint)
+{
+  omp_init_nest_lock_with_hint(lock, *hint);
+}
+
 void
 omp_destroy_lock(volatile omp_lock_t *lock)
 {
@@ -242,6 +301,7 @@ void omp_destroy_nest_lock_(volatile omp_nest_lock_t *);
 void
 omp_set_lock(volatile omp_lock_t *lock)
 {
+  __ompc_fuzzy_barrier_resolve();
   __ompc_lock((ompc_lock_t*)(*lock));
 }
 
@@ -252,6 +312,7 @@ void omp_set_lock_(volatile omp_lock_t *);
 void
 omp_set_nest_lock(volatile omp_nest_lock_t *lock)
 {
+  __ompc_fuzzy_barrier_resolve();
   __ompc_nest_lock((ompc_nest_lock_t*)(*lock));
 }
 
@@ -282,6 +343,7 @@ void omp_unset_nest_lock_(volatile omp_nest_lock_t *);
 int
 omp_test_lock(volatile omp_lock_t *lock)
 {
+  __ompc_fuzzy_barrier_resolve();
   return __ompc_test_lock((ompc_lock_t*)(*lock));
 }
 
@@ -291,6 +353,7 @@ int omp_test_lock_(volatile omp_lock_t *);
 
 int
 omp_test_nest_lock(volatile omp_nest_lock_t *lock){
+  __ompc_fuzzy_barrier_resolve();
   return __ompc_test_nest_lock((ompc_nest_lock_t*)(*lock));
 }
 
@@ -39,6 +39,8 @@
  
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
 #include "omp_lock.h"
 #include "omp_rtl.h"
 #include "omp_sys.h"
@@ -47,13 +49,245 @@
 
 extern int __omp_spin_user_lock;
 
+/* OMPC_LOCK_TAS: one word, taken with a compare-and-swap when free.
+ * A thread that finds it held spins for the spin budget, then marks it
+ * 2 and sleeps on it; the holder wakes one sleeper when it sees 2. */
+static inline int
+__ompc_tas_test_lock(volatile int *word)
+{
+  return *word == 0 && __ompc_cas(word, 0, 1);
+}
+
+static inline void
+__ompc_tas_lock(volatile int *word)
+{
+  omp_spin_t spin;
+
+  if (__ompc_cas(word, 0, 1))
+    return;
+  __ompc_spin_init(&spin);
+  while (__ompc_spin(&spin)) {
+    if (__ompc_tas_test_lock(word))
+      return;
+  }
+  while (__sync_lock_test_and_set(word, 2) != 0)
+    __ompc_futex_wait(word, 2, 0);
+}
+
+static inline void
+__ompc_tas_unlock(volatile int *word)
+{
+  if (__ompc_atomic_dec(word) != 0) {
+    *word = 0;
+    __ompc_futex_wake(word, 1);
+  }
+}
+
+/* OMPC_LOCK_ADAPTIVE: the futex word of OMPC_LOCK_TAS, but a waiter
+ * spins only when the lock is expected to be free soon: the running
+ * averages of its hold and wait times are within the spin budget, nobody
+ * sleeps on it yet, and there are no more threads than processors, so the
+ * holder is likely running. It spins for twice the expected time, then
+ * parks. An acquire that found the lock free counts as a wait of 0, so
+ * the wait average comes back down once the contention is gone. Only
+ * the locks of the program get it, see __ompc_init_user_lock.
+ */
+#define ADAPTIVE_EWMA_WEIGHT	8	/* a new sample counts for 1/8 */
+#define ADAPTIVE_MIN_SPIN_TIME	1000	/* ns, before anything is learned */
+
+static inline long int
+__ompc_adaptive_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline void
+__ompc_adaptive_learn(int *average, long int sample)
+{
+  if (sample > INT_MAX)
+    sample = INT_MAX;
+  *average += (int) ((sample - *average) / ADAPTIVE_EWMA_WEIGHT);
+}
+
+static inline int
+__ompc_adaptive_test_lock(ompc_adaptive_lock_t *lck)
+{
+  if (lck->word != 0 || !__ompc_cas(&lck->word, 0, 1))
+    return 0;
+  __ompc_adaptive_learn(&lck->wait_time, 0);
+  lck->since = __ompc_adaptive_now();
+  return 1;
+}
+
+static inline void
+__ompc_adaptive_lock(ompc_adaptive_lock_t *lck)
+{
+  long int start, expected, spins, budget;
+
+  if (__ompc_adaptive_test_lock(lck))
+    return;
+
+  start = __ompc_adaptive_now();
+  expected = lck->hold_time > lck->wait_time ?
+             lck->hold_time : lck->wait_time;
+  if (expected <= __omp_spin_time && lck->word != 2 &&
+      __omp_nthreads_var <= __omp_num_processors) {
+    /* relax hints in twice the expected time, at most the spin budget */
+    budget = __omp_spin_count;
+    if (2 * expected + ADAPTIVE_MIN_SPIN_TIME < __omp_spin_time)
+      budget = (long int) ((double) __omp_spin_count *
+                           (2 * expected + ADAPTIVE_MIN_SPIN_TIME) /
+                           __omp_spin_time);
+    for (spins = 0; spins < budget && lck->word == 1; spins++)
+      __ompc_cpu_relax();
+    if (lck->word == 0 && __ompc_cas(&lck->word, 0, 1))
+      goto acquired;
+  }
+  while (__sync_lock_test_and_set(&lck->word, 2) != 0)
+    __ompc_futex_wait(&lck->word, 2, 0);
+
+acquired:
+  lck->since = __ompc_adaptive_now();
+  __ompc_adaptive_learn(&lck->wait_time, lck->since - start);
+}
+
+static inline void
+__ompc_adaptive_unlock(ompc_adaptive_lock_t *lck)
+{
+  __ompc_adaptive_learn(&lck->hold_time,
+                        __ompc_adaptive_now() - lck->since);
+  if (__ompc_atomic_dec(&lck->word) != 0) {
+    lck->word = 0;
+    __ompc_futex_wake(&lck->word, 1);
+  }
+}
+
+/* OMPC_LOCK_QUEUE, see omp_lock.h. Each thread keeps the nodes it is
+ * done with for the next acquire; a node is never freed, since the thread
+ * that released it to us may still be waking it up. */
+static __thread ompc_mcs_node_t *__omp_mcs_free_nodes;
+
+static inline ompc_mcs_node_t *
+__ompc_mcs_node_get(void)
+{
+  ompc_mcs_node_t *node = __omp_mcs_free_nodes;
+
+  if (node != NULL) {
+    __omp_mcs_free_nodes = node->free_next;
+  } else {
+    node = aligned_malloc(sizeof(ompc_mcs_node_t), CACHE_LINE_SIZE);
+    Is_True(node != NULL, ("Cannot allocate MCS lock node"));
+    node->sleepers = 0;
+  }
+  node->next = NULL;
+  node->locked = 1;
+  return node;
+}
+
+static inline void
+__ompc_mcs_node_put(ompc_mcs_node_t *node)
+{
+  node->free_next = __omp_mcs_free_nodes;
+  __omp_mcs_free_nodes = node;
+}
+
+static inline int
+__ompc_mcs_test_lock(ompc_mcs_lock_t *lck)
+{
+  ompc_mcs_node_t *node;
+
+  if (lck->tail != NULL)
+    return 0;
+  node = __ompc_mcs_node_get();
+  if (!__sync_bool_compare_and_swap(&lck->tail, NULL, node)) {
+    __ompc_mcs_node_put(node);
+    return 0;
+  }
+  lck->holder = node;
+  return 1;
+}
+
+static inline void
+__ompc_mcs_lock(ompc_mcs_lock_t *lck)
+{
+  ompc_mcs_node_t *node, *pred;
+
+  node = __ompc_mcs_node_get();
+  __ompc_mfence();
+  pred = __sync_lock_test_and_set(&lck->tail, node);
+  if (pred != NULL) {
+    pred->next = node;
+    __ompc_wait_eq(&node->locked, 0, &node->sleepers);
+    __ompc_mfence();
+  }
+  lck->holder = node;
+}
+
+static inline void
+__ompc_mcs_unlock(ompc_mcs_lock_t *lck)
+{
+  ompc_mcs_node_t *node = lck->holder, *succ;
+
+  if (node->next == NULL) {
+    if (__sync_bool_compare_and_swap(&lck->tail, node, NULL)) {
+      __ompc_mcs_node_put(node);
+      return;
+    }
+    /* a thread swapped itself in and is about to link behind us */
+    OMPC_WAIT_WHILE(node->next == NULL);
+  }
+  succ = node->next;
+  __ompc_mfence();
+  succ->locked = 0;
+  __ompc_wake(&succ->locked, &succ->sleepers);
+  __ompc_mcs_node_put(node);
+}
+
+/* The locks of the RTL itself, such as those of the task queues, are
+ * taken on hot paths and are not worth timing: under
+ * O64_OMP_SPIN_USER_LOCK=adaptive they stay mutexes. */
 inline void 
 __ompc_init_lock (volatile ompc_lock_t *lp)
 {
-  if (__omp_spin_user_lock == 0)
-    pthread_mutex_init(&(lp->lock.mutex_data), NULL);
-  else
-    pthread_spin_init(&(lp->lock.spin_data), PTHREAD_PROCESS_PRIVATE);
+  __ompc_init_lock_kind(lp, __omp_spin_user_lock == OMPC_LOCK_ADAPTIVE ?
+                            OMPC_LOCK_MUTEX :
+                            (ompc_lock_kind_t) __omp_spin_user_lock);
+}
+
+/* A lock of the program: omp_init_lock, critical */
+void
+__ompc_init_user_lock (volatile ompc_lock_t *lp)
+{
+  __ompc_init_lock_kind(lp, (ompc_lock_kind_t) __omp_spin_user_lock);
+}
+
+void
+__ompc_init_lock_kind (volatile ompc_lock_t *lp, ompc_lock_kind_t kind)
+{
+  lp->flag = kind;
+  switch (kind) {
+    case OMPC_LOCK_MUTEX:
+      pthread_mutex_init(&(lp->lock.mutex_data), NULL);
+      break;
+    case OMPC_LOCK_SPIN:
+      pthread_spin_init(&(lp->lock.spin_data), PTHREAD_PROCESS_PRIVATE);
+      break;
+    case OMPC_LOCK_ADAPTIVE:
+      lp->lock.adaptive_data.word = 0;
+      lp->lock.adaptive_data.hold_time = 0;
+      lp->lock.adaptive_data.wait_time = 0;
+      break;
+    case OMPC_LOCK_TAS:
+      lp->lock.tas_data = 0;
+      break;
+    case OMPC_LOCK_QUEUE:
+      lp->lock.mcs_data.tail = NULL;
+      lp->lock.mcs_data.holder = NULL;
+      break;
+  }
 }
 
 inline void
@@ -88,10 +322,23 @@ __ompc_lock(volatile ompc_lock_t *lp)
     __ompc_ompt_set_state(THR_LKWT_STATE, ompt_state_wait_lock, p_vthread->wait_id);
     __ompc_ompt_event_callback(OMP_EVENT_THR_BEGIN_LKWT, ompt_event_wait_lock);
 #endif
-  if (__omp_spin_user_lock == 0)
-    pthread_mutex_lock(&(lp->lock.mutex_data));
-  else 
-    pthread_spin_lock(&(lp->lock.spin_data));
+  switch (lp->flag) {
+    case OMPC_LOCK_MUTEX:
+      pthread_mutex_lock(&(lp->lock.mutex_data));
+      break;
+    case OMPC_LOCK_SPIN:
+      pthread_spin_lock(&(lp->lock.spin_data));
+      break;
+    case OMPC_LOCK_ADAPTIVE:
+      __ompc_adaptive_lock((ompc_adaptive_lock_t *) &(lp->lock.adaptive_data));
+      break;
+    case OMPC_LOCK_TAS:
+      __ompc_tas_lock(&(lp->lock.tas_data));
+      break;
+    case OMPC_LOCK_QUEUE:
+      __ompc_mcs_lock((ompc_mcs_lock_t *) &(lp->lock.mcs_data));
+      break;
+  }
 #ifdef OMPT
   __ompc_ompt_event_callback(OMP_EVENT_THR_END_LKWT, ompt_event_acquired_lock);
 #endif
@@ -102,10 +349,23 @@ __ompc_lock(volatile ompc_lock_t *lp)
 inline void 
 __ompc_unlock (volatile ompc_lock_t *lp)
 {
-  if (__omp_spin_user_lock == 0)
-    pthread_mutex_unlock(&(lp->lock.mutex_data));
-  else 
-    pthread_spin_unlock(&(lp->lock.spin_data));
+  switch (lp->flag) {
+    case OMPC_LOCK_MUTEX:
+      pthread_mutex_unlock(&(lp->lock.mutex_data));
+      break;
+    case OMPC_LOCK_SPIN:
+      pthread_spin_unlock(&(lp->lock.spin_data));
+      break;
+    case OMPC_LOCK_ADAPTIVE:
+      __ompc_adaptive_unlock((ompc_adaptive_lock_t *) &(lp->lock.adaptive_data));
+      break;
+    case OMPC_LOCK_TAS:
+      __ompc_tas_unlock(&(lp->lock.tas_data));
+      break;
+    case OMPC_LOCK_QUEUE:
+      __ompc_mcs_unlock((ompc_mcs_lock_t *) &(lp->lock.mcs_data));
+      break;
+  }
 
 #ifdef OMPT
   __ompc_ompt_event_callback(OMP_EVENT_THR_END_LKWT, ompt_event_release_lock);
@@ -126,9 +386,9 @@ __ompc_unlock_s(volatile ompc_lock_t *lp)
 inline void 
 __ompc_destroy_lock (volatile ompc_lock_t *lp)
 {
-  if (__omp_spin_user_lock == 0)
+  if (lp->flag == OMPC_LOCK_MUTEX)
     pthread_mutex_destroy(&(lp->lock.mutex_data));
-  else 
+  else if (lp->flag == OMPC_LOCK_SPIN)
     pthread_spin_destroy(&(lp->lock.spin_data));
 }
 
@@ -136,182 +396,177 @@ __ompc_destroy_lock (volatile ompc_lock_t *lp)
 inline int 
 __ompc_test_lock (volatile ompc_lock_t *lp)
 {
-  if (__omp_spin_user_lock == 0)
-    return (pthread_mutex_trylock(&(lp->lock.mutex_data)) == 0);
-  else
-    return (pthread_spin_trylock(&(lp->lock.spin_data)) == 0);
+  switch (lp->flag) {
+    case OMPC_LOCK_MUTEX:
+      return (pthread_mutex_trylock(&(lp->lock.mutex_data)) == 0);
+    case OMPC_LOCK_SPIN:
+      return (pthread_spin_trylock(&(lp->lock.spin_data)) == 0);
+    case OMPC_LOCK_ADAPTIVE:
+      return __ompc_adaptive_test_lock(
+               (ompc_adaptive_lock_t *) &(lp->lock.adaptive_data));
+    case OMPC_LOCK_TAS:
+      return __ompc_tas_test_lock(&(lp->lock.tas_data));
+    default:
+      return __ompc_mcs_test_lock((ompc_mcs_lock_t *) &(lp->lock.mcs_data));
+  }
 }
 
 
+/* Nest lock owners are numbered on their first nest lock, from 1, so
+ * that 0 means free. The number comes shifted into place in the word. */
+static volatile int __omp_nest_lock_owners;
+static __thread unsigned int __omp_nest_lock_owner;
+
+static inline unsigned int
+__ompc_nest_lock_owner(void)
+{
+  if (__omp_nest_lock_owner == 0) {
+    int owner = __ompc_atomic_inc(&__omp_nest_lock_owners);
+    Is_True(owner <= OMPC_NEST_LOCK_MAX_OWNER,
+            ("too many threads took a nest lock"));
+    __omp_nest_lock_owner = (unsigned int) owner << OMPC_NEST_LOCK_DEPTH_BITS;
+  }
+  return __omp_nest_lock_owner;
+}
+
+/* The depth of word once the owner nests once more */
+static inline int
+__ompc_nest_lock_deeper(int word)
+{
+  Is_True((word & OMPC_NEST_LOCK_MAX_DEPTH) < OMPC_NEST_LOCK_MAX_DEPTH,
+          ("omp_set_nest_lock: nested too deep"));
+  return word + 1;
+}
+
 void 
 __ompc_init_nest_lock (volatile ompc_nest_lock_t *lp)
 {
-  __ompc_init_lock (&lp->lock);
-  __ompc_init_lock (&lp->wait);
-  lp->count = 0;
+  __ompc_init_nest_lock_kind(lp, (ompc_lock_kind_t) __omp_spin_user_lock);
+}
 
-#ifdef OMPT
-  lp->max_count = 0;
-#endif
+/* kind is that of waiters, the lock the other threads queue on while
+ * the owner holds word */
+void
+__ompc_init_nest_lock_kind (volatile ompc_nest_lock_t *lp,
+                            ompc_lock_kind_t kind)
+{
+  __ompc_init_lock_kind(&lp->waiters, kind);
+  lp->word = 0;
+  lp->sleepers = 0;
 }
 
 void
 __ompc_init_nest_lock_s (volatile ompc_nest_lock_t *lp)
 {
-  __ompc_init_lock (&lp->lock);
-  __ompc_init_lock (&lp->wait);
-  lp->count = 0;
+  __ompc_init_nest_lock(lp);
 }
 
-
+/* A thread only ever finds its own number in word if it wrote it there
+ * itself, so nesting needs no atomic. */
 void 
 __ompc_nest_lock (volatile ompc_nest_lock_t *lp)
 {
-  pthread_t id = pthread_self();
-  int nest;
+  unsigned int owner = __ompc_nest_lock_owner();
+  int word = lp->word;
 
-  if( (lp->count > 0) && (lp->thread_id == id) ) {
-    nest = 1;
-  } else {
-	wait_nest_lock:
+  if ((word & ~OMPC_NEST_LOCK_MAX_DEPTH) == (int) owner) {
+    lp->word = __ompc_nest_lock_deeper(word);
 #ifdef OMPT
-	__ompt_set_state(ompt_state_wait_nest_lock, (ompt_wait_id_t) &lp);
-	__ompt_event_callback(ompt_event_wait_nest_lock);
+    __ompt_event_callback(ompt_event_acquired_nest_lock_next);
 #endif
-    __ompc_lock(&lp->wait); /* be blocked here */
-    nest = 0;
+    return;
   }
-  __ompc_lock(&lp->lock);
-  if(nest) {
-    if( lp->count == 0 ) { /* the 'wait' lock be released */
-      if(!__ompc_test_lock(&lp->wait)) {
-		__ompc_unlock(&lp->lock);
-		goto wait_nest_lock;
-      }
-      lp->thread_id = id;
-    } else { /* lp->count > 0 */
-      if(lp->thread_id != id) {
-		__ompc_unlock(&lp->lock);
-		goto wait_nest_lock;
-      }
+
+  if (word != 0 || !__ompc_cas(&lp->word, 0, (int) owner + 1)) {
+#ifdef OMPT
+    __ompt_set_state(ompt_state_wait_nest_lock, (ompt_wait_id_t) &lp);
+    __ompt_event_callback(ompt_event_wait_nest_lock);
+#endif
+    /* the first in waiters takes word as soon as it is free: spinning
+     * for a spin lock, through the wait engine otherwise */
+    __ompc_lock(&lp->waiters);
+    while (lp->word != 0 || !__ompc_cas(&lp->word, 0, (int) owner + 1)) {
+      if (lp->waiters.flag == OMPC_LOCK_SPIN)
+        __ompc_cpu_relax();
+      else
+        __ompc_wait_eq(&lp->word, 0, &lp->sleepers);
     }
-    lp->count++;
-  }  else { /* get the 'wait' lock. Assert:( lp->count == 0 ) */
-    lp->thread_id = id;
-    lp->count = 1;
+    __ompc_unlock(&lp->waiters);
   }
 #ifdef OMPT
-  __ompt_event_callback((lp->count == 1) ? ompt_event_acquired_nest_lock_first : ompt_event_acquired_nest_lock_next);
+  __ompt_event_callback(ompt_event_acquired_nest_lock_first);
 #endif
-  __ompc_unlock(&lp->lock);
 }
 
 void
 __ompc_nest_lock_s (volatile ompc_nest_lock_t *lp)
 {
-  pthread_t id = pthread_self();
-  int nest;
-
-  if( (lp->count > 0) && (lp->thread_id == id) ) {
-    nest = 1;
-  } else {
-  wait_nest_lock:
-    __ompc_lock_s(&lp->wait); /* be blocked here */
-    nest = 0;
-  }
-  __ompc_lock(&lp->lock);
-  if(nest) {
-    if( lp->count == 0 ) { /* the 'wait' lock be released */
-      if(!__ompc_test_lock(&lp->wait)) {
-        __ompc_unlock(&lp->lock);
-        goto wait_nest_lock;
-      }
-      lp->thread_id = id;
-    } else { /* lp->count > 0 */
-      if(lp->thread_id != id) {
-        __ompc_unlock(&lp->lock);
-        goto wait_nest_lock;
-      }
-    }
-    lp->count++;
-  }  else { /* get the 'wait' lock. Assert:( lp->count == 0 ) */
-    lp->thread_id = id;
-    lp->count = 1;
-  }
-  __ompc_unlock(&lp->lock);
+  __ompc_nest_lock(lp);
 }
 
 
 void 
 __ompc_nest_unlock (volatile ompc_nest_lock_t *lp)
 {
-  __ompc_lock (&lp->lock);
-  if(lp->count > 0){
-#ifdef OMPT
-	if(lp->max_count < lp->count)
-		lp->max_count = lp->count;
-
-	__ompt_event_callback((lp->max_count == lp->count && lp->max_count != 0) ? ompt_event_release_nest_lock_last : ompt_event_release_nest_lock_prev);
-#endif
-    lp->count--;
+  int word = lp->word;
+  int owned = (word & ~OMPC_NEST_LOCK_MAX_DEPTH) ==
+              (int) __ompc_nest_lock_owner();
+
+  Is_True(owned, ("omp_unset_nest_lock: the lock is not owned by "
+                  "the calling thread"));
+  if (!owned)
+    return;
 #ifdef OMPT
-  if(lp->count == 0)
-	  lp->max_count = 0;
+  __ompt_event_callback((word & OMPC_NEST_LOCK_MAX_DEPTH) == 1 ?
+                        ompt_event_release_nest_lock_last :
+                        ompt_event_release_nest_lock_prev);
 #endif
-    if(lp->count == 0){
-      __ompc_unlock(&lp->wait);
-    }
+  if ((word & OMPC_NEST_LOCK_MAX_DEPTH) > 1) {
+    lp->word = word - 1;
+    return;
   }
-  __ompc_unlock (&lp->lock);
+  lp->word = 0;
+  if (lp->waiters.flag != OMPC_LOCK_SPIN)
+    __ompc_wake(&lp->word, &lp->sleepers);
 }
 
 void
 __ompc_nest_unlock_s (volatile ompc_nest_lock_t *lp)
 {
-  __ompc_lock (&lp->lock);
-  if(lp->count > 0){
-    lp->count--;
-    if(lp->count == 0){
-      __ompc_unlock(&lp->wait);
-    }
-  }
-  __ompc_unlock (&lp->lock);
+  __ompc_nest_unlock(lp);
 }
 
 
 void 
 __ompc_destroy_nest_lock (volatile ompc_nest_lock_t *lp)
 {
-  __ompc_destroy_lock (&lp->wait);
-  __ompc_destroy_lock (&lp->lock);
+  __ompc_destroy_lock(&lp->waiters);
 }
 
-
 int 
 __ompc_test_nest_lock (volatile ompc_nest_lock_t *lp)
 {
-  pthread_t id = pthread_self();
-    
-  __ompc_lock(&lp->lock);
-  if(lp->count > 0){
-    if(lp->thread_id == id){
-      lp->count++;
-    }
-    else{
-      __ompc_unlock(&lp->lock);
-      return 0;
-    }
-  }
-  else{
-    if(!__ompc_test_lock(&lp->wait)){
-      __ompc_unlock(&lp->lock);
-      return 0;
-    }
-    lp->thread_id = id;
-    lp->count = 1;
+  unsigned int owner = __ompc_nest_lock_owner();
+  int word = lp->word;
+
+  if ((word & ~OMPC_NEST_LOCK_MAX_DEPTH) == (int) owner) {
+    lp->word = word = __ompc_nest_lock_deeper(word);
+    return word & OMPC_NEST_LOCK_MAX_DEPTH;
   }
-  __ompc_unlock(&lp->lock);
-  return lp->count;
+  if (word != 0 || !__ompc_cas(&lp->word, 0, (int) owner + 1))
+    return 0;
+  return 1;
+}
+
+/* The lock of a critical name or a reduction, of the kind
+ * O64_OMP_CRITICAL_LOCK selected */
+static inline void
+__ompc_init_critical_lock(volatile ompc_lock_t *lp)
+{
+  if (__omp_critical_lock == OMP_CRITICAL_LOCK_MCS)
+    __ompc_init_lock_kind(lp, OMPC_LOCK_QUEUE);
+  else
+    __ompc_init_user_lock(lp);
 }
 
 /* for Critical directive */
@@ -320,6 +575,7 @@ __ompc_test_nest_lock (volatile ompc_nest_lock_t *lp)
 inline void
 __ompc_critical(int gtid, volatile ompc_lock_t **lck)
 {
+  __ompc_fuzzy_barrier_resolve();
   __ompc_ompt_set_state(THR_OVHD_STATE, ompt_state_overhead, 0);
   if (*lck == NULL) {
     __ompc_lock_spinlock(&_ompc_thread_lock);
@@ -329,7 +585,7 @@ __ompc_critical(int gtid, volatile ompc_lock_t **lck)
         aligned_malloc(sizeof(ompc_lock_t), CACHE_LINE_SIZE);
       Is_True(new_lock!=NULL, 
 	      ("Cannot allocate lock memory for critical"));
-      __ompc_init_lock (new_lock);
+      __ompc_init_critical_lock (new_lock);
       *lck = new_lock;
     }
     __ompc_unlock_spinlock(&_ompc_thread_lock);
@@ -361,6 +617,7 @@ __ompc_end_critical(int gtid, volatile ompc_lock_t **lck)
 inline void
 __ompc_reduction(int gtid, volatile ompc_lock_t **lck)
 {
+  __ompc_fuzzy_barrier_resolve();
   __ompc_ompt_set_state(THR_OVHD_STATE, ompt_state_overhead, 0);
   if (*lck ==NULL) {
     __ompc_lock_spinlock(&_ompc_thread_lock);
@@ -370,7 +627,7 @@ __ompc_reduction(int gtid, volatile ompc_lock_t **lck)
         aligned_malloc(sizeof(ompc_lock_t), CACHE_LINE_SIZE);
       Is_True(new_lock!=NULL, 
           ("Cannot allocate lock memory for reduction"));
-      __ompc_init_lock (new_lock);
+      __ompc_init_critical_lock (new_lock);
       *lck = new_lock;
     }
     __ompc_unlock_spinlock(&_ompc_thread_lock);
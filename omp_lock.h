@@ -44,33 +44,84 @@
 #include <pthread.h>
 #include "omp_util.h"
 
+/* MCS queue lock: a thread queues a node of its own and waits on it,
+ * the holder hands the lock over to the next node in FIFO order. */
+typedef struct ompc_mcs_node {
+  struct ompc_mcs_node * volatile next;
+  volatile int locked;
+  volatile int sleepers;
+  struct ompc_mcs_node *free_next;	/* in the free nodes of the thread */
+} __attribute__ ((__aligned__(ALIGN_SIZE))) ompc_mcs_node_t;
+
+typedef struct {
+  ompc_mcs_node_t * volatile tail;
+  ompc_mcs_node_t *holder;		/* node of the thread in the section */
+} ompc_mcs_lock_t;
+
+/* Adaptive lock: a futex word like the test-and-set lock, plus what
+ * the lock learned of its hold and wait times, in ns */
+typedef struct {
+  volatile int word;		/* 0 free, 1 held, 2 held with sleepers */
+  int hold_time;		/* running averages, updated by the holder */
+  int wait_time;
+  long int since;		/* when the holder took it */
+} ompc_adaptive_lock_t;
+
+/* Engine behind an ompc_lock_t, kept in its flag. The first three are
+ * the values of O64_OMP_SPIN_USER_LOCK, the default of every lock; the
+ * others are picked per lock by omp_init_lock_with_hint and critical. */
+typedef enum {
+  OMPC_LOCK_MUTEX = 0,
+  OMPC_LOCK_SPIN = 1,
+  OMPC_LOCK_ADAPTIVE = 2,	/* spin or park, as the lock has learned */
+  OMPC_LOCK_TAS,	/* test-and-set word, for uncontended locks */
+  OMPC_LOCK_QUEUE	/* MCS queue, for contended locks */
+} ompc_lock_kind_t;
+
 typedef struct {
   pthread_spinlock_t data;
 }__attribute__ ((__aligned__(ALIGN_SIZE))) ompc_spinlock_t;
 
 typedef struct {
-  int __attribute__ ((__aligned__(ALIGN_SIZE))) flag;
+  int __attribute__ ((__aligned__(ALIGN_SIZE))) flag;	/* ompc_lock_kind_t */
   union{
     pthread_spinlock_t spin_data;
     pthread_mutex_t mutex_data;
+    volatile int tas_data;	/* 0 free, 1 held, 2 held with sleepers */
+    ompc_mcs_lock_t mcs_data;
+    ompc_adaptive_lock_t adaptive_data;
   } lock;
 }__attribute__ ((__aligned__(ALIGN_SIZE))) ompc_lock_t;
 
 #ifndef __OPENMP_LOCK_TYPE_DEFINED_
 #define __OPENMP_LOCK_TYPE_DEFINED_
 
-typedef struct {
-   ompc_lock_t      lock, wait;
-   pthread_t       thread_id;
-   int             count;
+/* Nest lock: one word holds the number of the owner thread and the
+ * nesting depth, 0 when free. The first acquire swaps it in from 0, the
+ * owner nests with a load, a compare and a store, and the last release
+ * stores 0. Threads that find it held queue on waiters, of the kind the
+ * lock was initialized with, so that only the first of them waits on
+ * word. */
+#define OMPC_NEST_LOCK_DEPTH_BITS	12
+#define OMPC_NEST_LOCK_MAX_DEPTH	((1 << OMPC_NEST_LOCK_DEPTH_BITS) - 1)
+#define OMPC_NEST_LOCK_MAX_OWNER	((1 << (32 - OMPC_NEST_LOCK_DEPTH_BITS)) - 1)
 
-#ifdef OMPT
-   int				max_count;
-#endif
+typedef struct {
+   volatile int    word;	/* owner << OMPC_NEST_LOCK_DEPTH_BITS | depth */
+   volatile int    sleepers;	/* the first waiter, parked on word */
+   ompc_lock_t     waiters;
 } ompc_nest_lock_t;
 
 #endif
 
+/* lock behind critical and reduction, set by O64_OMP_CRITICAL_LOCK */
+typedef enum {
+  OMP_CRITICAL_LOCK_MCS = 0,
+  OMP_CRITICAL_LOCK_PTHREAD	/* the default kind, see O64_OMP_SPIN_USER_LOCK */
+} omp_critical_lock_t;
+
+extern omp_critical_lock_t __omp_critical_lock;
+
 
 static inline void
 __ompc_init_spinlock(ompc_spinlock_t *lck_p)
@@ -103,12 +154,16 @@ __ompc_try_spinlock(ompc_spinlock_t *lck)
 }
 
 extern void __ompc_init_lock (volatile ompc_lock_t *);
+extern void __ompc_init_lock_kind (volatile ompc_lock_t *, ompc_lock_kind_t);
+extern void __ompc_init_user_lock (volatile ompc_lock_t *);
 extern void __ompc_lock (volatile ompc_lock_t *);
 extern void __ompc_unlock (volatile ompc_lock_t *);
 extern void __ompc_destroy_lock (volatile ompc_lock_t *);
 extern int __ompc_test_lock (volatile ompc_lock_t *);
 
 extern void __ompc_init_nest_lock (volatile ompc_nest_lock_t *);
+extern void __ompc_init_nest_lock_kind (volatile ompc_nest_lock_t *,
+                                        ompc_lock_kind_t);
 extern void __ompc_nest_lock (volatile ompc_nest_lock_t *);
 extern void __ompc_nest_unlock (volatile ompc_nest_lock_t *);
 
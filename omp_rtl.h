@@ -54,16 +54,24 @@
 #include "omp_task_pool.h"
 #include "omp_sys.h"
 #include "omp_xbarrier.h"
+#include "omp_wait.h"
 
 /* default setting values*/
 #define OMP_NESTED_DEFAULT	0	
 #define OMP_DYNAMIC_DEFAULT	0
 #define OMP_NUM_THREADS_DEFAULT 4  	
-/* The limit of current pThread lib imposed.
- * Will be eliminated using NPTL
+/* Default upper bound on the threads the RTL may create, can be
+ * overridden by OMP_THREAD_LIMIT. No table is sized from it: per-thread
+ * tables grow with the teams actually created.
  */
-#define OMP_MAX_NUM_THREADS 	256
+#define OMP_THREAD_LIMIT_DEFAULT 	0x10000
 #define OMP_STACK_SIZE_DEFAULT	0x400000L /* 4MB*/
+/* top of its stack a slave faults in itself once it is bound */
+#define OMP_STACK_PREFAULT_SIZE	0x10000L /* 64KB*/
+/* fan-out of the tree used to release the level-1 team at fork */
+#define OMP_FORK_TREE_RADIX	4
+/* team shells the nested pool keeps for each nesting level */
+#define OMP_NESTED_TEAM_CACHE_SIZE	8
 
 #define OMP_POINTER_SIZE	8
 
@@ -117,6 +125,9 @@ extern volatile int __omp_nested;	  /* nested enable/disable */
 extern volatile int __omp_dynamic;	  /* dynamic enable/disable */
 /* max num of thread available*/
 extern volatile int __omp_max_num_threads;
+extern volatile int __omp_thread_limit;
+/* create level-1 slaves at the first fork, not at start up */
+extern int __omp_lazy_create;
 /* stores the number of threads requested for future parallel regions. */
 extern volatile int __omp_nthreads_var;
 /* num of hardware processors */
@@ -160,15 +171,29 @@ typedef struct omp_u_thread omp_u_thread_t;
 typedef struct omp_v_thread omp_v_thread_t;
 typedef struct omp_team	    omp_team_t;
 typedef struct omp_loop_info omp_loop_info_t;
+typedef struct omp_nested_worker omp_nested_worker_t;
+typedef struct omp_fork_flag omp_fork_flag_t;
+typedef struct omp_nested_pool omp_nested_pool_t;
 
 /* kernel thread*/
 struct omp_u_thread{
   pthread_t uthread_id;		/* pthread id*/
   omp_u_thread_t *hash_next;	/* hash link*/
   omp_v_thread_t *task;		/* task(vthread)*/
-  char *stack_pointer;
+  char *stack_pointer;		/* stack from stack_alloc()*/
+  int spawn_end;		/* end of the slave range this thread creates*/
 } __attribute__ ((__aligned__(CACHE_LINE_SIZE))) ;
 
+/* Per-thread release flag of the level-1 fork. A worker waits on its
+ * own flag, which is allocated on its own so that it does not move when
+ * __omp_level_1_team is reallocated.
+ */
+struct omp_fork_flag {
+  volatile int go;		/* fork generation released to this thread*/
+  volatile int sleeping;	/* parked on go, see __ompc_wait_ne*/
+  volatile int joined;		/* last generation whose join was left*/
+} __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+
 struct omp_loop_info {
   int       is_64bit;
   omp_int64 lower_bound;
@@ -224,12 +249,15 @@ struct omp_team {
 
   /* for single*/
   // offset = 264
-  ompc_lock_t	single_lock;
-  volatile int	single_count; 
+  volatile int	single_count;	/* singles claimed, see __ompc_single */
   //	volatile int	single_open; /* Single section protector*/
-  /* for copyprivate*/
+  /* for copyprivate: the single thread publishes cppriv under the next
+   * cppriv_seq, cppriv_counter counts the team out, the single thread
+   * last */
   volatile int	cppriv_counter;
-  void * cppriv;
+  void * volatile cppriv;
+  volatile int	cppriv_seq;
+  volatile int	cppriv_sleepers;
 
   /* for team barrier*/
   /* TODO: optimize the barrier implementation, test the performance */
@@ -237,6 +265,14 @@ struct omp_team {
   volatile int barrier_count;
   volatile int barrier_count2;
   volatile int exit_count;
+  /* threads parked in the team barriers, see __ompc_wait_eq */
+  volatile int barrier_sleepers;
+
+  /* for split-phase barrier: arrivals of the current phase, the phase,
+   * and the threads parked until it changes */
+  volatile int split_count;
+  volatile int split_phase;
+  volatile int split_sleepers;
 
   /* Still need a way to indicate there are new tasks for level_1 team.
    * For level-1 team, new_task will function as a counter -- the number of
@@ -257,6 +293,16 @@ struct omp_team {
   omp_task_pool_t *task_pool;
 
   omp_xbarrier_info_t  xbarrier_info;
+  omp_xbarrier_t xbarrier_type;	/* algorithm xbarrier_info is built for */
+  /* last xbarrier episode a thread of the team found free of tasks */
+  volatile int xbarrier_drained;
+  /* tournament barrier: the champion of the team releases it */
+  volatile boolean champion_sense;
+  /* one per thread, for __ompc_tree_reduction */
+  omp_reduction_slot_t *reduction_slots;
+
+  /* link in the cache of nested team shells, see __ompc_nested_team_get */
+  omp_team_t *next_shell;
 
 #ifdef OMPT
   volatile ompt_task_id_t collector_task_id;
@@ -294,6 +340,10 @@ struct omp_v_thread {
   omp_int64 rest_iter_count;
   /* For single sections*/
   int	single_count;
+  /* For copyprivate, the broadcasts seen in the region */
+  int	cppriv_seq;
+  /* set by __ompc_fuzzy_barrier until the team synchronizes next */
+  int	fuzzy_barrier;
   /* For Dynamic scheduler initialization*/
   int	loop_count;
   /* for 'lastprivate'? used ?*/
@@ -304,6 +354,9 @@ struct omp_v_thread {
 
   omp_xbarrier_local_info_t xbarrier_local;
 
+  /* level-1 only, the go flag the master releases this thread with */
+  omp_fork_flag_t *fork_flag;
+
   unsigned long thr_lkwt_state_id;
   unsigned long thr_ctwt_state_id;
   unsigned long thr_atwt_state_id;
@@ -320,8 +373,40 @@ struct omp_v_thread {
   char *idle_frame;
 #endif
 
+ } __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+
+/* A nested slave. It is created on demand by a nested fork and parked
+ * in __omp_nested_pool between nested regions instead of exiting, so that
+ * the pthread, its stack and the u/v_thread are reused.
+ */
+struct omp_nested_worker {
+  omp_u_thread_t uthread;
+  omp_v_thread_t vthread;
+
+  omp_nested_worker_t *next;	/* link in the free list of the pool*/
+  int level;			/* nesting level this worker serves*/
+
+  /* go is bumped by the master to start a region. busy is cleared
+   * by the worker once it no longer touches the team, so the master
+   * may put it back into the pool.
+   */
+  volatile int go __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+  volatile int sleeping;	/* parked on go, see __ompc_wait_ne*/
+  volatile int busy;
+  volatile int busy_sleepers;	/* master parked on busy*/
 } __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
 
+/* parked nested workers of one nesting level */
+struct omp_nested_pool {
+  omp_nested_worker_t *free_list;
+  int num_idle;
+  int num_workers;
+  /* teams of finished regions, kept with their task pool and xbarrier
+   * info for the next nested region of the same size */
+  omp_team_t *free_teams;
+  int num_free_teams;
+};
+
 /* The array for level 1 thread team, 
  * using vthread_id to index them
  */
@@ -330,7 +415,8 @@ extern omp_u_thread_t *  __omp_level_1_pthread;
 extern int		 __omp_level_1_team_size;
 extern volatile omp_team_t	 __omp_level_1_team_manager;
 extern int		 __omp_level_1_team_alloc_size;
-extern omp_u_thread_t *  __omp_uthread_hash_table[UTHREAD_HASH_SIZE]; 
+extern omp_u_thread_t ** __omp_uthread_hash_table; 
+extern unsigned long int __omp_uthread_hash_size;
 
 /* Where do they should be initialized? */
 extern pthread_t 	 __omp_root_thread_id;
@@ -340,6 +426,8 @@ extern omp_team_t	 __omp_root_team;     /* hold information for sequential part*
 
 extern void __ompc_set_state(OMP_COLLECTOR_API_THR_STATE state);
 extern void __ompc_event_callback(OMP_COLLECTORAPI_EVENT event);
+/* no events but the thread and idle ones while set */
+extern volatile int __omp_internal_region;
 
 
 /* prototypes, implementations are defined in omp_thread.h
@@ -367,6 +455,9 @@ extern omp_team_t * __ompc_get_current_team(void);
 
 
 extern void __ompc_barrier(void);
+extern void __ompc_fuzzy_barrier(void);
+extern int __ompc_barrier_arrive(void);
+extern void __ompc_barrier_wait_phase(int phase);
 extern void __ompc_pr_exit(void);
 extern void __ompc_flush(void *p);
 extern int __ompc_ok_to_fork(void);
@@ -411,6 +502,9 @@ extern void __ompc_set_xbarrier_wait();
 extern void __ompc_xbarrier_info_init(omp_team_t *team);
 extern void __ompc_xbarrier_info_create(omp_team_t *team);
 extern void __ompc_xbarrier_info_destroy(omp_team_t *team);
+extern void __ompc_tree_reduction(int gtid, void *data, int size,
+                                  void (*combine)(void *inout, void *in),
+                                  int broadcast);
 extern void
 __ompc_init_xbarrier_local_info( omp_xbarrier_local_info_t *local,
                                  int vpid, omp_team_t *team);
@@ -425,9 +519,21 @@ extern __thread int __omp_seed;
 /*every thread has a local copy of its current v_thread */
 extern __thread omp_v_thread_t *__omp_current_v_thread;
 
-extern volatile unsigned long int __omp_task_stack_size;
+/* Runs the barrier a __ompc_fuzzy_barrier left pending. Called first by
+ * every other entry point that synchronizes with the team or orders
+ * memory: worksharing, critical, locks, flush, copyin, tasks and the
+ * nested or serialized forks. The barriers and the joins stand in for it
+ * themselves.
+ */
+static inline void __ompc_fuzzy_barrier_resolve(void)
+{
+  omp_v_thread_t *p_vthread = __omp_current_v_thread;
 
-extern volatile int __omp_empty_flags[OMP_MAX_NUM_THREADS];
+  if (p_vthread != NULL && p_vthread->fuzzy_barrier)
+    __ompc_barrier();
+}
+
+extern volatile unsigned long int __omp_task_stack_size;
 
 extern unsigned long current_region_id;
 extern unsigned long current_parent_id;
@@ -86,6 +86,9 @@ extern "C" {
  /* added by Oscar Hernandez at the University of Houston 2009 */
   extern void __ompc_reduction(omp_int32 gtid, omp_int32 **lck);
   extern void __ompc_end_reduction(omp_int32 gtid, omp_int32 **lck);
+  extern void __ompc_tree_reduction(omp_int32 gtid, void *data, omp_int32 size,
+                                    void (*combine)(void *inout, void *in),
+                                    omp_int32 broadcast);
 
   /* Not exposed any longer*/
   /* TODO: Fix the Interface*/
@@ -136,6 +139,9 @@ extern "C" {
 
   extern void __ompc_barrier(void);
   extern void __ompc_ebarrier(void);
+  extern void __ompc_fuzzy_barrier(void);
+  extern omp_int32 __ompc_barrier_arrive(void);
+  extern void __ompc_barrier_wait_phase(omp_int32 phase);
   extern void __ompc_ordered(omp_int32 global_tid);
   extern void __ompc_end_ordered(omp_int32 global_tid);
 
@@ -109,6 +109,8 @@ __ompc_static_init_4 (omp_int32 global_tid, omp_sched_t schedtype,
   omp_int32 stride;
   omp_v_thread_t *p_vthread;  
 
+  __ompc_fuzzy_barrier_resolve();
+
 #ifdef OMPT
   __ompt_event_callback(ompt_event_loop_begin);
 #endif
@@ -192,6 +194,8 @@ __ompc_static_init_8 (omp_int32 global_tid, omp_sched_t schedtype,
   omp_int64 stride;
   omp_v_thread_t *p_vthread;  
 
+  __ompc_fuzzy_barrier_resolve();
+
 #ifdef OMPT
   __ompt_event_callback(ompt_event_loop_begin);
 #endif
@@ -316,6 +320,8 @@ __ompc_scheduler_init_4 (omp_int32 global_tid, omp_sched_t schedtype,
   omp_team_t     *p_team;
   omp_v_thread_t *p_vthread;
 
+  __ompc_fuzzy_barrier_resolve();
+
 #ifdef OMPT
   __ompt_event_callback(ompt_event_loop_begin);
 #endif
@@ -403,6 +409,8 @@ __ompc_scheduler_init_8 (omp_int32 global_tid, omp_sched_t schedtype,
   omp_team_t     *p_team;
   omp_v_thread_t *p_vthread;
 
+  __ompc_fuzzy_barrier_resolve();
+
 #ifdef OMPT
   __ompt_event_callback(ompt_event_loop_begin);
 #endif
@@ -1331,6 +1339,7 @@ __ompc_collapse_init (omp_int32 global_tid, omp_sched_t schedtype,
   unsigned       i;
   omp_loop_info_t *loop_info;
 
+  __ompc_fuzzy_barrier_resolve();
   va_start(ap, collapse_count);
   __ompc_ompt_set_state(THR_OVHD_STATE, ompt_state_overhead, 0);
   /* TODO: The validity of the parameters should be checked here*/
@@ -1705,6 +1714,7 @@ __ompc_ordered (omp_int32 global_tid)
   omp_v_thread_t	*p_vthread;
   omp_team_t	*p_team;
 	
+  __ompc_fuzzy_barrier_resolve();
   if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
     return;
   
@@ -1777,6 +1787,22 @@ __ompc_end_ordered (omp_int32 global_tid)
  * How to implement single to ensure the right semantics?
  */
 
+/* Each thread counts the single constructs it met, the team the ones
+ * claimed. A thread reaching its n-th single finds the team count at
+ * n-1 if the construct is unclaimed, since it helped claim the previous
+ * ones, and at n or beyond otherwise, when threads are ahead under
+ * nowait. The thread whose CAS moves the count from n-1 to n executes
+ * the construct; the others go on without waiting.
+ */
+static inline int
+__ompc_single_claim(omp_team_t *p_team, omp_v_thread_t *p_vthread)
+{
+  int count = ++p_vthread->single_count;
+
+  return p_team->single_count == count - 1 &&
+         __ompc_cas(&p_team->single_count, count - 1, count);
+}
+
 omp_int32 
 __ompc_single (omp_int32 global_tid) 
 {
@@ -1788,6 +1814,7 @@ __ompc_single (omp_int32 global_tid)
   omp_v_thread_t *p_vthread;
   int	is_first = 0;
 
+  __ompc_fuzzy_barrier_resolve();
   if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
     return 1;
   if (__omp_exe_mode & OMP_EXE_MODE_NORMAL) {
@@ -1807,14 +1834,7 @@ __ompc_single (omp_int32 global_tid)
     return 1;
   }
 
-  p_vthread->single_count++;
-
-  __ompc_lock(&(p_team->single_lock));
-  if (p_team->single_count < p_vthread->single_count) {
-    p_team->single_count++;
-    is_first = 1;
-  }
-  __ompc_unlock(&(p_team->single_lock));
+  is_first = __ompc_single_claim(p_team, p_vthread);
   if (is_first) {
 #ifndef OMPT
     __ompc_set_state(THR_WORK_STATE);
@@ -1861,6 +1881,7 @@ __ompc_workshare (omp_int32 global_tid)
   omp_v_thread_t *p_vthread;
   int	is_first = 0;
 
+  __ompc_fuzzy_barrier_resolve();
   if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
     return 1;
   if (__omp_exe_mode & OMP_EXE_MODE_NORMAL) {
@@ -1878,13 +1899,7 @@ __ompc_workshare (omp_int32 global_tid)
 
   /* used to select which thread will execute non-shared work units in the
    * workshare region */
-  p_vthread->single_count++;
-  __ompc_lock(&(p_team->single_lock));
-  if (p_team->single_count < p_vthread->single_count) {
-    p_team->single_count++;
-    is_first = 1;
-  }
-  __ompc_unlock(&(p_team->single_lock));
+  is_first = __ompc_single_claim(p_team, p_vthread);
 
   if (is_first)
 	  __ompc_ompt_set_state(THR_WORK_STATE, ompt_state_work_parallel, 0);
@@ -1911,6 +1926,7 @@ __ompc_end_workshare (omp_int32 global_tid)
 omp_int32
 __ompc_master (omp_int32 global_tid) 
 {
+  __ompc_fuzzy_barrier_resolve();
   __ompc_ompt_set_state(THR_OVHD_STATE, ompt_state_overhead, 0);
   if (global_tid == 0) {
 	__ompc_ompt_event_callback(OMP_EVENT_THR_BEGIN_MASTER, ompt_event_master_begin);
@@ -1937,30 +1953,48 @@ __ompc_end_master (omp_int32 global_tid)
  *  datap: the address of the original global scope variable
  *  global_tid: thread id of current thread which tries to get its own threadprivate variable
  *
+ * The pointer array is sized from the level 1 team and grown on demand.
+ * Its capacity is kept in the slot just before the array. A grown array
+ * is published with the old entries copied over; the old one is never
+ * freed, since other threads may still index it through *thdprv_p.
  * 
  * By Chunhua Liao
  */
+#define THDPRV_CAPACITY(pp) ((long)((pp)[-1]))
+
 omp_int32 
 __ompc_get_thdprv(void *** thdprv_p, omp_int64 size, void *datap,omp_int32 global_tid)
 {
-  void **pp,*p;
-
-  int num_threads;
- 
-  num_threads=OMP_MAX_NUM_THREADS;
-//  printf("ompc_get_thdprv: num_threads = %d\n", num_threads);
-  if((pp = *thdprv_p) == NULL) {
-    __ompc_lock_spinlock(&_ompc_thread_lock);
-
-    if((pp = *thdprv_p) == NULL) {
-      // put the shared data aligned with the cache line size
-      pp = aligned_malloc(sizeof(void *)*num_threads, CACHE_LINE_SIZE);
-      Is_True (pp !=NULL, "cannot allocate memory");
-      bzero(pp,sizeof(void *)*num_threads);
-      *thdprv_p = pp;
-    }
-    __ompc_unlock_spinlock(&_ompc_thread_lock);
+  void **pp, **new_pp, *p;
+  long capacity;
+
+  pp = *thdprv_p;
+  if (pp != NULL && global_tid < THDPRV_CAPACITY(pp) && pp[global_tid] != NULL)
+    return 1;
+
+  __ompc_lock_spinlock(&_ompc_thread_lock);
+
+  pp = *thdprv_p;
+  if (pp == NULL || global_tid >= THDPRV_CAPACITY(pp)) {
+    capacity = __omp_level_1_team_alloc_size;
+    if (pp != NULL && capacity < 2 * THDPRV_CAPACITY(pp))
+      capacity = 2 * THDPRV_CAPACITY(pp);
+    if (capacity <= global_tid)
+      capacity = global_tid + 1;
+
+    // put the shared data aligned with the cache line size
+    new_pp = aligned_malloc(sizeof(void *) * (capacity + 1), CACHE_LINE_SIZE);
+    Is_True (new_pp !=NULL, "cannot allocate memory");
+    bzero(new_pp, sizeof(void *) * (capacity + 1));
+    new_pp[0] = (void *) capacity;
+    new_pp++;
+    if (pp != NULL)
+      memcpy(new_pp, pp, sizeof(void *) * THDPRV_CAPACITY(pp));
+    __ompc_mfence();
+    *thdprv_p = pp = new_pp;
   }
+
+  /* the slot is written under the lock, so a concurrent grow can't lose it */
   if((p = pp[global_tid]) == NULL) {
     if(global_tid == 0)
       p = datap;
@@ -1971,6 +2005,8 @@ __ompc_get_thdprv(void *** thdprv_p, omp_int64 size, void *datap,omp_int32 globa
     pp[global_tid] = p;
   }
 
+  __ompc_unlock_spinlock(&_ompc_thread_lock);
+
   return 1;
 }
 
@@ -1984,6 +2020,8 @@ __ompc_copyin_thdprv(int num,... )
   va_list arguments;
   int x;
 
+  __ompc_fuzzy_barrier_resolve();
+
   va_start (arguments,num);
   iter=num/3;
   for (x=0;x<iter;x++)  {
@@ -2014,20 +2052,40 @@ __ompc_copyprivate(omp_int32 mpsp_status, void *cppriv,\
 {
   omp_v_thread_t *temp_v_thread; /*user thread*/
   omp_team_t *p_team;        
+  int seq;
 
+  __ompc_fuzzy_barrier_resolve();
   temp_v_thread = __ompc_get_current_v_thread();
   p_team = temp_v_thread->team;
-  p_team->cppriv_counter= p_team->team_size;
 
-  if (mpsp_status==1)
-    p_team->cppriv=(void *)cppriv;
-  __ompc_barrier(); //make sure the single thread set team value first
-  if (mpsp_status!=1)
-    cp(p_team->cppriv, cppriv);
+  if (p_team->team_size == 1)
+    return 0;
 
-  //This one is a must because the single thread may die before other threads copy their values 
-  __ompc_barrier();
-  /* if it is the last thread, free the shared copyprivate data in the team structure */
+  /* every thread of the team takes part in each broadcast, in order */
+  seq = ++temp_v_thread->cppriv_seq;
+
+  if (mpsp_status==1) {
+    /* the previous broadcast is over once its publisher counted itself
+     * out, the last of all */
+    __ompc_wait_eq(&p_team->cppriv_counter, 0, &p_team->cppriv_sleepers);
+    p_team->cppriv_counter = p_team->team_size;
+    p_team->cppriv = (void *)cppriv;
+    __ompc_mfence();
+    p_team->cppriv_seq = seq;
+    __ompc_wake(&p_team->cppriv_seq, &p_team->cppriv_sleepers);
+
+    /* cppriv points into our frame, stay until everyone copied */
+    __ompc_wait_eq(&p_team->cppriv_counter, 1, &p_team->cppriv_sleepers);
+    p_team->cppriv_counter = 0;
+    __ompc_wake(&p_team->cppriv_counter, &p_team->cppriv_sleepers);
+  } else {
+    __ompc_wait_eq(&p_team->cppriv_seq, seq, &p_team->cppriv_sleepers);
+    __ompc_mfence();
+    cp(p_team->cppriv, cppriv);
+    if (__ompc_atomic_dec(&p_team->cppriv_counter) == 1)
+      __ompc_wake(&p_team->cppriv_counter, &p_team->cppriv_sleepers);
+  }
+  return 0;
 }
 
 /*
@@ -69,6 +69,19 @@ static inline void __ompc_mfence()
 
 #endif
 
+/* hint to the CPU that we are in a spin-wait loop */
+#if defined(TARG_X8664) || defined(TARG_IA32)
+static inline void __ompc_cpu_relax()
+{
+  __asm__ __volatile__("pause":: : "memory");
+}
+#else
+static inline void __ompc_cpu_relax()
+{
+  __asm__ __volatile__("":: : "memory");
+}
+#endif
+
 static inline int __ompc_cas(volatile int *ptr, int ag, int x)
 {
   return __sync_bool_compare_and_swap(ptr, ag, x);
@@ -100,6 +100,7 @@ void __ompc_task_create(omp_task_func taskfunc, void *frame_pointer,
   omp_task_t *current_task, *new_task, *orig_task;
   omp_v_thread_t *current_thread;
 
+  __ompc_fuzzy_barrier_resolve();
   current_task = __omp_current_task;
 
   if (__ompc_task_cutoff()) {
@@ -227,7 +228,9 @@ void __ompc_task_wait()
   omp_team_t *team;
   omp_task_t *current_task, *next_task;
   omp_v_thread_t *current_thread;
+  omp_spin_t spin;
 
+  __ompc_fuzzy_barrier_resolve();
   current_thread = __omp_current_v_thread;
   current_task   = __omp_current_task;
 
@@ -248,10 +251,15 @@ void __ompc_task_wait()
   __ompc_task_set_state(current_task, OMP_TASK_WAITING);
 
   /* while there are still children, look for available work in task queues */
+  __ompc_spin_init(&spin);
   while ( current_task->num_children) {
     next_task = __ompc_remove_task_from_pool(team->task_pool);
     if (next_task != NULL) {
         __ompc_task_switch(next_task);
+    } else if (!__ompc_spin(&spin)) {
+        /* children still running elsewhere: new tasks wake us up, a
+         * finished child is noticed after wait_time */
+        __ompc_task_pool_idle_wait(team->task_pool, __omp_wait_time);
     }
   }
 
@@ -296,7 +304,9 @@ void __ompc_task_exit()
   if (__ompc_task_is_deferred(current_task)) {
     Is_True(current_task->parent != NULL,
             ("deferred task should has a NULL parent"));
-    __ompc_atomic_dec(&team->task_pool->num_pending_tasks);
+    /* the last one may end a barrier that waits for the pool to drain */
+    if (__ompc_atomic_dec(&team->task_pool->num_pending_tasks) == 0)
+      __ompc_task_pool_wake_all_idle(team->task_pool);
     num_siblings = __ompc_atomic_dec(&current_task->parent->num_children);
   }
 
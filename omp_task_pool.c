@@ -86,6 +86,136 @@ omp_queue_item_t (*__ompc_task_queue_steal_chunk)(omp_queue_t *src,
                                                   int chunk_size);
 
 
+/* __ompc_task_pool_idle_create:
+ * Sets up the idle registry of a pool, one slot per thread.
+ */
+void __ompc_task_pool_idle_create(omp_task_pool_t *pool, int team_size)
+{
+  pool->idle = aligned_malloc(sizeof(omp_task_idle_slot_t) * team_size,
+                              CACHE_LINE_SIZE);
+  Is_True(pool->idle != NULL,
+      ("__ompc_task_pool_idle_create: couldn't malloc idle registry"));
+  memset(pool->idle, 0, sizeof(omp_task_idle_slot_t) * team_size);
+  pool->num_idle_slots = team_size;
+  pool->num_idle = 0;
+}
+
+/* __ompc_task_pool_idle_expand:
+ * Grows the idle registry. Only called between parallel regions, when
+ * nobody is parked in the pool.
+ */
+void __ompc_task_pool_idle_expand(omp_task_pool_t *pool, int new_team_size)
+{
+  if (new_team_size <= pool->num_idle_slots)
+    return;
+
+  pool->idle = aligned_realloc((void *) pool->idle,
+                    sizeof(omp_task_idle_slot_t) * pool->num_idle_slots,
+                    sizeof(omp_task_idle_slot_t) * new_team_size,
+                    CACHE_LINE_SIZE);
+  Is_True(pool->idle != NULL,
+      ("__ompc_task_pool_idle_expand: couldn't expand idle registry"));
+  memset(&pool->idle[pool->num_idle_slots], 0,
+         sizeof(omp_task_idle_slot_t) *
+         (new_team_size - pool->num_idle_slots));
+  pool->num_idle_slots = new_team_size;
+}
+
+void __ompc_task_pool_idle_destroy(omp_task_pool_t *pool)
+{
+  aligned_free(pool->idle);
+}
+
+/* __ompc_task_pool_idle_enter, _sleep, _leave:
+ * Publish the slot of the calling thread in the idle registry, sleep
+ * until a waker claims it or for at most ns nanoseconds, withdraw. A
+ * waiter that checks its condition between enter and sleep cannot miss
+ * a wake for it, as long as the waker sets the condition before it
+ * looks at num_idle.
+ */
+void __ompc_task_pool_idle_enter(omp_task_pool_t *pool)
+{
+  Is_True(__omp_myid < pool->num_idle_slots,
+      ("__ompc_task_pool_idle_enter: thread has no idle slot"));
+
+  pool->idle[__omp_myid].parked = 1;
+  __ompc_atomic_inc(&pool->num_idle);
+}
+
+void __ompc_task_pool_idle_sleep(omp_task_pool_t *pool, long int ns)
+{
+  __ompc_futex_wait(&pool->idle[__omp_myid].parked, 1, ns);
+}
+
+void __ompc_task_pool_idle_leave(omp_task_pool_t *pool)
+{
+  /* withdraw, unless a waker has claimed the slot already */
+  __ompc_cas(&pool->idle[__omp_myid].parked, 1, 0);
+  __ompc_atomic_dec(&pool->num_idle);
+}
+
+/* __ompc_task_pool_idle_wait:
+ * Parks the calling thread in the idle registry until a producer picks
+ * it for a new task, or for at most ns nanoseconds. A task added after
+ * the slot was published always finds the thread; one added just
+ * before is picked up when the park times out.
+ */
+void __ompc_task_pool_idle_wait(omp_task_pool_t *pool, long int ns)
+{
+  __ompc_task_pool_idle_enter(pool);
+  __ompc_task_pool_idle_sleep(pool, ns);
+  __ompc_task_pool_idle_leave(pool);
+}
+
+/* __ompc_task_pool_wake_one:
+ * Wakes one parked thread for a new task, looking for the idle thread
+ * nearest to the producer first.
+ */
+void __ompc_task_pool_wake_one(omp_task_pool_t *pool)
+{
+  int myid = __omp_myid;
+  int size = pool->num_idle_slots;
+  int d, i;
+
+  for (d = 1; d < size; d++) {
+    i = myid + d;
+    if (i < size && pool->idle[i].parked &&
+        __ompc_cas(&pool->idle[i].parked, 1, 0)) {
+      __ompc_futex_wake(&pool->idle[i].parked, 1);
+      return;
+    }
+    i = myid - d;
+    if (i >= 0 && pool->idle[i].parked &&
+        __ompc_cas(&pool->idle[i].parked, 1, 0)) {
+      __ompc_futex_wake(&pool->idle[i].parked, 1);
+      return;
+    }
+  }
+}
+
+/* __ompc_task_pool_wake_all:
+ * Wakes every parked thread, for a condition they may all wait on.
+ */
+void __ompc_task_pool_wake_all(omp_task_pool_t *pool)
+{
+  int size = pool->num_idle_slots;
+  int i;
+
+  for (i = 0; i < size; i++) {
+    if (pool->idle[i].parked && __ompc_cas(&pool->idle[i].parked, 1, 0))
+      __ompc_futex_wake(&pool->idle[i].parked, 1);
+  }
+}
+
+/* __ompc_task_pool_wake_thread:
+ * Wakes thread id if it is parked, for a condition only it waits on.
+ */
+void __ompc_task_pool_wake_thread(omp_task_pool_t *pool, int id)
+{
+  if (pool->idle[id].parked && __ompc_cas(&pool->idle[id].parked, 1, 0))
+    __ompc_futex_wake(&pool->idle[id].parked, 1);
+}
+
 /* level ids */
 #define PER_THREAD 0
 
@@ -112,7 +242,7 @@ omp_task_pool_t * __ompc_create_task_pool_default(int team_size)
   new_pool->level = aligned_malloc(sizeof(omp_task_queue_level_t),
                                    CACHE_LINE_SIZE);
   pthread_mutex_init(&(new_pool->pool_lock), NULL);
-  pthread_cond_init(&(new_pool->pool_cond), NULL);
+  __ompc_task_pool_idle_create(new_pool, team_size);
 
   Is_True(new_pool->level != NULL,
       ("__ompc_create_task_pool: couldn't malloc level"));
@@ -170,6 +300,8 @@ omp_task_pool_t * __ompc_expand_task_pool_default(omp_task_pool_t *pool,
                       __omp_task_queue_num_slots);
   }
 
+  __ompc_task_pool_idle_expand(pool, new_team_size);
+
   return pool;
 }
 
@@ -190,11 +322,7 @@ int __ompc_add_task_to_pool_default(omp_task_pool_t *pool, omp_task_t *task)
   /* num_pending_tasks track not just tasks entered into the task pool, but
    * also tasks marked as deferred that could not fit into the task pool
    */
-  if (__ompc_atomic_inc(&pool->num_pending_tasks) == 1) {
-    pthread_mutex_lock(&pool->pool_lock);
-    pthread_cond_broadcast(&pool->pool_cond);
-    pthread_mutex_unlock(&pool->pool_lock);
-  }
+  __ompc_atomic_inc(&pool->num_pending_tasks);
 
   per_thread = &pool->level[PER_THREAD];
 
@@ -209,6 +337,10 @@ int __ompc_add_task_to_pool_default(omp_task_pool_t *pool, omp_task_t *task)
                         &per_thread->task_queue[UNTIED_IDX(myid)],
                         task);
 
+  /* one queued task, one sleeper */
+  if (success)
+    __ompc_task_pool_wake_idle(pool);
+
   return success;
 }
 
@@ -360,6 +492,7 @@ void __ompc_destroy_task_pool_default(omp_task_pool_t *pool)
   }
 
   pthread_mutex_destroy(&pool->pool_lock);
+  __ompc_task_pool_idle_destroy(pool);
 
   aligned_free(per_thread->task_queue); /* free queues in level 0 */
   aligned_free(pool->level); /* free the level array */
@@ -42,13 +42,26 @@ struct omp_task_queue_level {
 } __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
 typedef struct omp_task_queue_level omp_task_queue_level_t;
 
+/* Slot of a thread in the idle registry of a task pool. A thread that
+ * runs out of tasks sets parked and sleeps on it; a task producer
+ * claims the slot (parked 1 -> 0) and wakes just that thread.
+ */
+struct omp_task_idle_slot {
+  volatile int parked;
+} __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+typedef struct omp_task_idle_slot omp_task_idle_slot_t;
+
 struct omp_task_pool {
   omp_task_queue_level_t *level;
 
   /* Number of deferred tasks that are pending (i.e. have not yet exited) */
   volatile int num_pending_tasks;
   pthread_mutex_t pool_lock;
-  pthread_cond_t pool_cond;
+
+  /* idle registry, one slot per thread of the team */
+  omp_task_idle_slot_t *idle;
+  int num_idle_slots;
+  volatile int num_idle;
 
   int num_levels;
   int team_size;
@@ -69,6 +82,44 @@ static inline void __ompc_task_pool_set_team_size(omp_task_pool_t *pool,
 }
 
 
+/* idle registry, shared by all the task pool implementations */
+extern void __ompc_task_pool_idle_create(omp_task_pool_t *pool, int team_size);
+extern void __ompc_task_pool_idle_expand(omp_task_pool_t *pool,
+                                         int new_team_size);
+extern void __ompc_task_pool_idle_destroy(omp_task_pool_t *pool);
+extern void __ompc_task_pool_idle_enter(omp_task_pool_t *pool);
+extern void __ompc_task_pool_idle_sleep(omp_task_pool_t *pool, long int ns);
+extern void __ompc_task_pool_idle_leave(omp_task_pool_t *pool);
+extern void __ompc_task_pool_idle_wait(omp_task_pool_t *pool, long int ns);
+extern void __ompc_task_pool_wake_one(omp_task_pool_t *pool);
+extern void __ompc_task_pool_wake_all(omp_task_pool_t *pool);
+extern void __ompc_task_pool_wake_thread(omp_task_pool_t *pool, int id);
+
+/* Called by a producer after a task was counted in num_pending_tasks */
+static inline void __ompc_task_pool_wake_idle(omp_task_pool_t *pool)
+{
+  if (pool->num_idle > 0)
+    __ompc_task_pool_wake_one(pool);
+}
+
+/* Called after setting a condition that parked threads wait on, such
+ * as a barrier flag: the fence orders it before the look at num_idle */
+static inline void __ompc_task_pool_wake_all_idle(omp_task_pool_t *pool)
+{
+  __ompc_mfence();
+  if (pool->num_idle > 0)
+    __ompc_task_pool_wake_all(pool);
+}
+
+/* Likewise, for a condition that only thread id waits on */
+static inline void __ompc_task_pool_wake_idle_thread(omp_task_pool_t *pool,
+                                                     int id)
+{
+  __ompc_mfence();
+  if (pool->num_idle > 0)
+    __ompc_task_pool_wake_thread(pool, id);
+}
+
 /* external interface */
 extern int __omp_task_queue_num_slots;
 extern int __omp_task_chunk_size;
@@ -48,12 +48,22 @@
 #include <ctype.h>
 #include <time.h>
 #include <malloc.h>
+#include <alloca.h>
+#include <fcntl.h>
 #include "omp_thread.h"
 #include "omp_sys.h"
 #include "omp_xbarrier.h"
 
-#define SPIN_COUNT_DEFAULT 20000
+#define SPIN_COUNT_DEFAULT 0	/* derived from SPIN_TIME_DEFAULT */
+#define SPIN_TIME_DEFAULT 100000
 #define WAIT_TIME_DEFAULT 5000
+/* OMP_DYNAMIC samples the system load at most once per interval, in ns */
+#define DYNAMIC_SAMPLE_INTERVAL 10000000
+/* barriers timed for each algorithm by O64_OMP_XBARRIER_TYPE=auto,
+ * after a few untimed ones, unless they take longer than the time, in ns */
+#define XBARRIER_CALIBRATE_COUNT 200
+#define XBARRIER_CALIBRATE_WARMUP 4
+#define XBARRIER_CALIBRATE_TIME 5000000
 #include "pcl.h"
 #include "omp_collector_util.h"
 #include "omp_collector_validation.h"
@@ -109,7 +119,9 @@ volatile int __omp_verbose = 0;
 volatile int __omp_nested = OMP_NESTED_DEFAULT;          /* nested enable/disable */
 volatile int __omp_dynamic = OMP_DYNAMIC_DEFAULT;         /* dynamic enable/disable */
 /* max num of thread available*/
-volatile int __omp_max_num_threads = OMP_MAX_NUM_THREADS - 1;
+volatile int __omp_max_num_threads = OMP_THREAD_LIMIT_DEFAULT - 1;
+/* max num of threads in the whole program, OMP_THREAD_LIMIT */
+volatile int __omp_thread_limit = OMP_THREAD_LIMIT_DEFAULT;
 /* stores the number of threads requested for future parallel regions. */
 volatile int __omp_nthreads_var;
 
@@ -134,8 +146,6 @@ volatile unsigned long int __omp_task_stack_size = OMP_TASK_STACK_SIZE_DEFAULT;
 
 __thread omp_exe_mode_t __omp_exe_mode = OMP_EXE_MODE_DEFAULT;
 
-volatile int __omp_empty_flags[OMP_MAX_NUM_THREADS];
-
 omp_v_thread_t * __omp_level_1_team = NULL;
 omp_u_thread_t * __omp_level_1_pthread = NULL;
 int		 __omp_level_1_team_size = 1;
@@ -143,7 +153,9 @@ int		 __omp_level_1_team_alloc_size = 1;
 volatile omp_team_t	 __omp_level_1_team_manager;
 // omp_team_t       temp_team;
 
-omp_u_thread_t * __omp_uthread_hash_table[UTHREAD_HASH_SIZE];
+/* sized by __ompc_resize_hash_table() */
+omp_u_thread_t ** __omp_uthread_hash_table = NULL;
+unsigned long int __omp_uthread_hash_size = 0;
 
 __thread omp_v_thread_t *__omp_current_v_thread;
 
@@ -154,6 +166,9 @@ volatile int __attribute__ ((__aligned__(CACHE_LINE_SIZE)))__omp_level_1_exit_co
 
 int __attribute__ ((__aligned__(CACHE_LINE_SIZE)))__omp_spin_user_lock = 0;
 
+// lock of critical sections and reductions, set by O64_OMP_CRITICAL_LOCK
+omp_critical_lock_t __omp_critical_lock = OMP_CRITICAL_LOCK_MCS;
+
 omp_team_t       __omp_root_team;
 omp_u_thread_t * __omp_root_u_thread;
 #ifdef OMPT
@@ -169,29 +184,47 @@ int              __omp_rtl_initialized = 0;
 // control variable for spin lock, it can be set by O64_OMP_SPIN_COUNT
 long int __omp_spin_count = SPIN_COUNT_DEFAULT;
 
+// spin budget in ns, it can be set by O64_OMP_SPIN_TIME
+long int __omp_spin_time = SPIN_TIME_DEFAULT;
+
+// it can be set by OMP_WAIT_POLICY
+omp_wait_policy_t __omp_wait_policy = OMP_WAIT_POLICY_DEFAULT;
+
 long int __omp_wait_time = WAIT_TIME_DEFAULT;
 
 // control variable for whether binding thread to cpu
 // it can be reset by O64_OMP_SET_AFFINITY
 int             __omp_set_affinity = 1;
 
+// create level-1 slaves at the first fork, only as many as requested
+// it can be set by O64_OMP_LAZY_CREATE
+int             __omp_lazy_create = 0;
+
+// pick the xbarrier algorithm at run time, set by O64_OMP_XBARRIER_TYPE
+int             __omp_xbarrier_auto = 0;
+
+// set while the RTL runs parallel regions of its own, such as the
+// xbarrier calibration: no tool hears of them
+volatile int    __omp_internal_region = 0;
+
 unsigned int numtasks = 0;
 //static volatile int __omp_global_team_count = 0;
 //static volatile int __omp_nested_team_count = 0;
 
-static pthread_attr_t	__omp_pthread_attr;
 //static pthread_barrierattr_t __omp_pthread_barrierattr;
 static volatile int  __omp_exit_now = 0;
 
-static pthread_mutex_t __omp_level_1_mutex;
-static pthread_cond_t __omp_level_1_cond;
-
-static pthread_mutex_t __omp_level_1_barrier_mutex;
-static pthread_cond_t __omp_level_1_barrier_cond;
+/* number of level-1 threads the current fork generation releases */
+static volatile int __omp_level_1_release_size = 1;
 
 pthread_mutex_t __omp_hash_table_lock;
 int ompc_req_start = 0;
 
+/* parked nested workers, indexed by nesting level */
+static omp_nested_pool_t *__omp_nested_pool = NULL;
+static int __omp_nested_pool_levels = 0;
+static pthread_mutex_t __omp_nested_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* maybe a separate attribute should be here for nested pthreads */
 
 /* sysnem lock variables */
@@ -206,7 +239,7 @@ void __ompc_fini_rtl();
 int  __ompc_init_rtl(int num_threads);
 void __ompc_expand_level_1_team(int new_num_threads);
 void *__ompc_level_1_slave(void *_u_thread_id);
-void *__ompc_nested_slave(void *_v_thread); 
+void *__ompc_nested_slave(void *_worker);
 
 
 void __ompc_set_state(OMP_COLLECTOR_API_THR_STATE state)
@@ -228,6 +261,10 @@ void __ompc_event_callback(OMP_COLLECTORAPI_EVENT event)
   //      printf("Thread %d EVENT=%d STATE=%d\n",p_vthread->vthread_id,
   //                              (int) event, (int) p_vthread->state);
 
+  if (__omp_internal_region && event != OMP_EVENT_THR_BEGIN_IDLE &&
+      event != OMP_EVENT_THR_END_IDLE)
+    return;
+
   if( __omp_level_1_team_manager.callbacks[event] && 
                   collector_initialized && (!collector_paused))
     __omp_level_1_team_manager.callbacks[event](event);
@@ -256,12 +293,21 @@ __ompc_environment_variables()
     }
   }
 	
+  env_var_str = getenv("OMP_THREAD_LIMIT");
+  if (env_var_str != NULL) {
+    sscanf(env_var_str, "%d", &env_var_val);
+    Is_Valid(env_var_val > 0, ("OMP_THREAD_LIMIT should be positive"));
+    __omp_thread_limit = env_var_val;
+    /* the master is not counted */
+    __omp_max_num_threads = env_var_val - 1;
+  }
+
   env_var_str = getenv("OMP_NUM_THREADS");
   if (env_var_str != NULL) {
     sscanf(env_var_str, "%d", &env_var_val);
     Is_Valid(env_var_val > 0, ("OMP_NUM_THREADS should be positive")); 
-    if (env_var_val > __omp_max_num_threads)
-      env_var_val = __omp_max_num_threads;
+    if (env_var_val > __omp_thread_limit)
+      env_var_val = __omp_thread_limit;
     __omp_nthreads_var = env_var_val;
   }
 
@@ -383,21 +429,59 @@ __ompc_environment_variables()
     __omp_spin_count = spin_count;
   }
 
+  env_var_str = getenv("O64_OMP_SPIN_TIME");
+  if (env_var_str != NULL) {
+    long int spin_time;
+    sscanf(env_var_str, "%ld", &spin_time);
+    Is_Valid(spin_time > 0, ("spin time must be positive"));
+    __omp_spin_time = spin_time;
+  }
+
+  env_var_str = getenv("OMP_WAIT_POLICY");
+  if (env_var_str != NULL) {
+    env_var_str = Trim_Leading_Spaces(env_var_str);
+    if (strncasecmp(env_var_str, "active", 6) == 0) {
+      __omp_wait_policy = OMP_WAIT_POLICY_ACTIVE;
+    } else if (strncasecmp(env_var_str, "passive", 7) == 0) {
+      __omp_wait_policy = OMP_WAIT_POLICY_PASSIVE;
+    } else {
+      Not_Valid("OMP_WAIT_POLICY should be set to: active/passive");
+    }
+  }
+
   env_var_str = getenv("O64_OMP_SPIN_USER_LOCK");
   if (env_var_str != NULL) {
     env_var_val = strncasecmp(env_var_str, "true", 4);
 
-    if (env_var_val == 0) {
+    if (strncasecmp(env_var_str, "adaptive", 8) == 0) {
+      __omp_spin_user_lock = OMPC_LOCK_ADAPTIVE;
+    } else if (env_var_val == 0) {
       __omp_spin_user_lock = 1;
     } else {
       env_var_val = strncasecmp(env_var_str, "false", 4);
       if (env_var_val == 0) {
         __omp_spin_user_lock = 0;
       } else {
-        Not_Valid("O64_OMP_SPIN_USER_LOCK should be set to: true/false");
+        Not_Valid("O64_OMP_SPIN_USER_LOCK should be set to: "
+                  "true/false/adaptive");
       }
     }
   }
+
+  env_var_str = getenv("O64_OMP_CRITICAL_LOCK");
+  if (env_var_str != NULL) {
+    if (strncasecmp(env_var_str, "mcs", 3) == 0) {
+      __omp_critical_lock = OMP_CRITICAL_LOCK_MCS;
+    } else if (strncasecmp(env_var_str, "pthread", 7) == 0) {
+      __omp_critical_lock = OMP_CRITICAL_LOCK_PTHREAD;
+    } else {
+      Not_Valid("O64_OMP_CRITICAL_LOCK should be set to: mcs/pthread");
+    }
+  } else if (__omp_nthreads_var > __omp_num_processors) {
+    /* the FIFO handoff of MCS waits for the next thread in line to be
+     * scheduled, a mutex lets whoever runs take the lock */
+    __omp_critical_lock = OMP_CRITICAL_LOCK_PTHREAD;
+  }
  
   env_var_str = getenv("O64_OMP_SET_AFFINITY");
   if (env_var_str != NULL) {
@@ -415,40 +499,83 @@ __ompc_environment_variables()
     }
   }
 
+  env_var_str = getenv("O64_OMP_LAZY_CREATE");
+  if (env_var_str != NULL) {
+    env_var_val = strncasecmp(env_var_str, "true", 4);
+
+    if (env_var_val == 0) {
+      __omp_lazy_create = 1;
+    } else {
+      env_var_val = strncasecmp(env_var_str, "false", 4);
+      if (env_var_val == 0) {
+        __omp_lazy_create = 0;
+      } else {
+        Not_Valid("O64_OMP_LAZY_CREATE should be set to: true/false");
+      }
+    }
+  }
+
   env_var_str = getenv("O64_OMP_XBARRIER_TYPE");
   if (env_var_str != NULL) {
     if (strncasecmp(env_var_str, "dissem", 6) == 0) {
       __omp_xbarrier_type = DISSEM_XBARRIER;
-      Warning("O64_OMP_XBARRIER_TYPE=dissem will not "
-              "work correctly with OpenMP 3.0 tasking model.");
     } else if (strncasecmp(env_var_str, "tree", 4) == 0) {
       __omp_xbarrier_type = TREE_XBARRIER;
-      Warning("O64_OMP_XBARRIER_TYPE=tree will not "
-              "work correctly with OpenMP 3.0 tasking model.");
     } else if (strncasecmp(env_var_str, "tour", 4) == 0) {
       __omp_xbarrier_type = TOUR_XBARRIER;
-      Warning("O64_OMP_XBARRIER_TYPE=tour will not "
-              "work correctly with OpenMP 3.0 tasking model.");
     } else if (strncasecmp(env_var_str, "simple", 6) == 0) {
       __omp_xbarrier_type = SIMPLE_XBARRIER;
-      Warning("O64_OMP_XBARRIER_TYPE=simple will not "
-              "work correctly with OpenMP 3.0 tasking model.");
+    } else if (strncasecmp(env_var_str, "hier", 4) == 0) {
+      __omp_xbarrier_type = HIER_XBARRIER;
     } else if (strncasecmp(env_var_str, "linear", 6) == 0) {
       __omp_xbarrier_type = LINEAR_XBARRIER;
+    } else if (strncasecmp(env_var_str, "auto", 4) == 0) {
+      /* until the first fork is calibrated */
+      __omp_xbarrier_type = LINEAR_XBARRIER;
+      __omp_xbarrier_auto = 1;
     } else  {
         Not_Valid("O64_OMP_XBARRIER_TYPE should be "
-                  "dissem|tree|tour|simple|linear or unset");
+                  "dissem|tree|tour|simple|hier|linear|auto or unset");
     }
   } else {
     __omp_xbarrier_type = LINEAR_XBARRIER;
   }
+
+  env_var_str = getenv("O64_OMP_XBARRIER_RADIX");
+  if (env_var_str != NULL) {
+    int arrival_radix, wakeup_radix;
+    int n = sscanf(env_var_str, "%d,%d", &arrival_radix, &wakeup_radix);
+    if (n == 1)
+      wakeup_radix = arrival_radix;
+    Is_Valid(n >= 1 && arrival_radix >= 2 &&
+             arrival_radix <= OMP_XBARRIER_MAX_ARRIVAL_RADIX &&
+             wakeup_radix >= 2 &&
+             wakeup_radix <= OMP_XBARRIER_MAX_WAKEUP_RADIX,
+             ("O64_OMP_XBARRIER_RADIX should be arrival[,wakeup], "
+              "with arrival in 2..8 and wakeup in 2..16"));
+    __omp_xbarrier_arrival_radix = arrival_radix;
+    __omp_xbarrier_wakeup_radix = wakeup_radix;
+  }
   __ompc_set_xbarrier_wait();
 
   __ompc_task_configure();
 
+  /* derive the spin budget from the wait settings */
+  __ompc_wait_init();
+
   if (__omp_verbose == 1) __ompc_print_environment();
 }
 
+static const char *__ompc_xbarrier_name(omp_xbarrier_t type)
+{
+  return type == DISSEM_XBARRIER ? "dissem" :
+         type == TREE_XBARRIER ? "tree" :
+         type == TOUR_XBARRIER ? "tour" :
+         type == SIMPLE_XBARRIER ? "simple" :
+         type == HIER_XBARRIER ? "hier" :
+         type == LINEAR_XBARRIER ? "linear" : "unknown";
+}
+
 static void __ompc_print_env_tag(char *env_name)
 {
   int i,j;
@@ -466,6 +593,10 @@ void __ompc_print_environment()
   __ompc_print_env_tag("OMP_NUM_THREADS");
   fprintf(stderr, "__omp_nthreads_var = %d\n",
           __omp_nthreads_var);
+  /* OMP_THREAD_LIMIT */
+  __ompc_print_env_tag("OMP_THREAD_LIMIT");
+  fprintf(stderr, "__omp_thread_limit = %d\n",
+          __omp_thread_limit);
   /* OMP_DYNAMIC */
   __ompc_print_env_tag("OMP_DYNAMIC");
   fprintf(stderr, "__omp_dynamic = %d\n",
@@ -497,22 +628,44 @@ void __ompc_print_environment()
   __ompc_print_env_tag("O64_OMP_SPIN_COUNT");
   fprintf(stderr, "__omp_spin_count = %ld\n",
           __omp_spin_count);
+  /* O64_OMP_SPIN_TIME */
+  __ompc_print_env_tag("O64_OMP_SPIN_TIME");
+  fprintf(stderr, "__omp_spin_time = %ld\n",
+          __omp_spin_time);
+  /* OMP_WAIT_POLICY */
+  __ompc_print_env_tag("OMP_WAIT_POLICY");
+  fprintf(stderr, "__omp_wait_policy = %s\n",
+          __omp_wait_policy == OMP_WAIT_POLICY_ACTIVE ? "active" :
+          __omp_wait_policy == OMP_WAIT_POLICY_PASSIVE ? "passive" : "default");
   /* O64_OMP_SPIN_USER_LOCK */
   __ompc_print_env_tag("O64_OMP_SPIN_USER_LOCK");
-  fprintf(stderr, "__omp_spin_user_lock = %d\n",
-          __omp_spin_user_lock);
+  fprintf(stderr, "__omp_spin_user_lock = %s\n",
+          __omp_spin_user_lock == OMPC_LOCK_ADAPTIVE ? "adaptive" :
+          __omp_spin_user_lock ? "true" : "false");
+  /* O64_OMP_CRITICAL_LOCK */
+  __ompc_print_env_tag("O64_OMP_CRITICAL_LOCK");
+  fprintf(stderr, "__omp_critical_lock = %s\n",
+          __omp_critical_lock == OMP_CRITICAL_LOCK_MCS ? "mcs" : "pthread");
   /* O64_OMP_SET_AFFINITY */
   __ompc_print_env_tag("O64_OMP_SET_AFFINITY");
   fprintf(stderr, "__omp_set_affinity = %d\n",
           __omp_set_affinity);
+  /* O64_OMP_LAZY_CREATE */
+  __ompc_print_env_tag("O64_OMP_LAZY_CREATE");
+  fprintf(stderr, "__omp_lazy_create = %d\n",
+          __omp_lazy_create);
   /* O64_OMP_XBARRIER_TYPE */
   __ompc_print_env_tag("O64_OMP_XBARRIER_TYPE");
-  fprintf(stderr, "__omp_xbarrier_type = %s\n",
-          __omp_xbarrier_type == DISSEM_XBARRIER ? "dissem" :
-          __omp_xbarrier_type == TREE_XBARRIER ? "tree" :
-          __omp_xbarrier_type == TOUR_XBARRIER ? "tour" :
-          __omp_xbarrier_type == SIMPLE_XBARRIER ? "simple" :
-          __omp_xbarrier_type == LINEAR_XBARRIER ? "linear" : "unknown");
+  if (__omp_xbarrier_auto)
+    fprintf(stderr, "__omp_xbarrier_type = auto, picked at the first fork\n");
+  else
+    fprintf(stderr, "__omp_xbarrier_type = %s\n",
+            __ompc_xbarrier_name(__omp_xbarrier_type));
+  /* O64_OMP_XBARRIER_RADIX */
+  __ompc_print_env_tag("O64_OMP_XBARRIER_RADIX");
+  fprintf(stderr, "__omp_xbarrier_arrival_radix = %d, "
+          "__omp_xbarrier_wakeup_radix = %d\n",
+          __omp_xbarrier_arrival_radix, __omp_xbarrier_wakeup_radix);
   /* O64_OMP_QUEUE_STORAGE */
   __ompc_print_env_tag("O64_OMP_QUEUE_STORAGE");
   fprintf(stderr, "__omp_queue_storage = %s\n",
@@ -1031,18 +1184,19 @@ void
 __ompc_level_1_barrier(const int vthread_id)
 {
   int *bar_count;
-  long int counter;
+  omp_spin_t spin;
   omp_v_thread_t *p_vthread;
   int myrank, team_size;
-  long int max_count;
   omp_task_t *next, *current_task;
   omp_task_pool_t *pool;
 
-  max_count = __omp_spin_count;
   p_vthread = __ompc_get_v_thread_by_num(__omp_myid);
   team_size = __omp_level_1_team_size;
   pool = __omp_level_1_team_manager.task_pool;
 
+  /* the join stands in for a pending fuzzy barrier */
+  p_vthread->fuzzy_barrier = 0;
+
   current_task = __omp_current_task;
   __ompc_task_set_state(current_task, OMP_TASK_IN_BARRIER);
 
@@ -1050,6 +1204,43 @@ __ompc_level_1_barrier(const int vthread_id)
   __ompc_ompt_set_state(THR_IBAR_STATE, ompt_state_wait_barrier_implicit, (ompt_wait_id_t) pool);
   __ompc_ompt_event_callback(OMP_EVENT_THR_BEGIN_IBAR, ompt_event_barrier_begin);
 
+  if (__ompc_xbarrier_join != NULL) {
+    /* Join through the selected xbarrier algorithm. The tasks of the
+     * region are finished first: a thread arrives only once it has seen
+     * the pool empty, and only running tasks can add new ones. The
+     * release half is the next fork.
+     */
+    __ompc_spin_init(&spin);
+    while (__ompc_task_pool_num_pending_tasks(pool)) {
+      if ((next = __ompc_remove_task_from_pool(pool)) != NULL) {
+        __ompc_task_switch(next);
+      } else if (!__ompc_spin(&spin)) {
+        /* the last task to exit wakes us up */
+        __ompc_task_pool_idle_enter(pool);
+        if (__ompc_task_pool_num_pending_tasks(pool))
+          __ompc_task_pool_idle_sleep(pool, __omp_wait_time);
+        __ompc_task_pool_idle_leave(pool);
+      }
+    }
+
+    __ompc_task_delete(__omp_level_1_team[vthread_id].implicit_task);
+    __omp_level_1_team[vthread_id].implicit_task = NULL;
+    __omp_level_1_team[vthread_id].num_suspended_tied_tasks = 0;
+
+#ifdef OMPT
+    __ompt_event_callback(ompt_event_wait_barrier_begin);
+#endif
+
+    __ompc_xbarrier_join((omp_team_t *) &__omp_level_1_team_manager);
+
+#ifdef OMPT
+    __ompt_event_callback(ompt_event_wait_barrier_end);
+#endif
+
+    __ompc_ompt_event_callback(OMP_EVENT_THR_END_IBAR, ompt_event_barrier_end);
+    return;
+  }
+
   bar_count = &__omp_level_1_team_manager.barrier_count;
   __ompc_atomic_inc(bar_count);
 
@@ -1057,26 +1248,18 @@ __ompc_level_1_barrier(const int vthread_id)
   __ompt_event_callback(ompt_event_wait_barrier_begin);
 #endif
 
-  for (counter = 0; (*bar_count < team_size) ||
-          __ompc_task_pool_num_pending_tasks(pool); counter++) {
+  __ompc_spin_init(&spin);
+  while ((*bar_count < team_size) ||
+          __ompc_task_pool_num_pending_tasks(pool)) {
 
       while (__ompc_task_pool_num_pending_tasks(pool) &&
              (next = __ompc_remove_task_from_pool(pool))) {
           if (next != NULL)
               __ompc_task_switch(next);
       }
-      if (counter > max_count) {
-          pthread_mutex_lock(&pool->pool_lock);
-          if (__ompc_task_pool_num_pending_tasks(pool) == 0 &&
-                  *bar_count < team_size) {
-              struct timespec ts;
-              clock_gettime(CLOCK_REALTIME, &ts);
-              ts.tv_nsec += __omp_wait_time;
-              pthread_cond_timedwait(&pool->pool_cond,
-                                     &pool->pool_lock,
-                                     &ts);
-          }
-          pthread_mutex_unlock(&pool->pool_lock);
+      if (!__ompc_spin(&spin)) {
+          /* new tasks wake us up, arrivals are seen after wait_time */
+          __ompc_task_pool_idle_wait(pool, __omp_wait_time);
       }
   }
 
@@ -1089,25 +1272,14 @@ __ompc_level_1_barrier(const int vthread_id)
 
   if (vthread_id == 0) {
     if (myrank != team_size)
-    {
-      for( counter = 0; __omp_level_1_exit_count != team_size; counter++) {
-        if (counter > max_count) {
-          pthread_mutex_lock(&__omp_level_1_barrier_mutex);
-          while (__omp_level_1_exit_count != team_size) {
-            pthread_cond_wait(&__omp_level_1_barrier_cond, &__omp_level_1_barrier_mutex);
-          }
-          pthread_mutex_unlock(&__omp_level_1_barrier_mutex);
-        }
-      }
-    }
+      __ompc_wait_eq(&__omp_level_1_exit_count, team_size,
+                     &__omp_level_1_team_manager.barrier_sleepers);
     __omp_level_1_exit_count = 0;
     *bar_count = 0;
   } else if (myrank == team_size ) {
-    // here we do need the mutex lock! otherwise,
-    // Otherwise, it's possible that cond_signal may fail to wake up the master thread.
-    pthread_mutex_lock(&__omp_level_1_barrier_mutex);
-    pthread_cond_signal(&__omp_level_1_barrier_cond);
-    pthread_mutex_unlock(&__omp_level_1_barrier_mutex);
+    /* the last one to arrive wakes up the master */
+    __ompc_wake(&__omp_level_1_exit_count,
+                &__omp_level_1_team_manager.barrier_sleepers);
   }
 
 #ifdef OMPT
@@ -1123,11 +1295,10 @@ __ompc_level_1_barrier(const int vthread_id)
 void
 __ompc_exit_barrier(omp_v_thread_t * vthread)
 {
-  long int counter;
+  omp_spin_t spin;
   int *bar_count;
   int *exit_count;
   int myrank;
-  long int max_count;
   omp_task_pool_t *pool;
   omp_task_t *next, *current_task;
   int team_size = vthread->team->team_size;
@@ -1137,8 +1308,8 @@ __ompc_exit_barrier(omp_v_thread_t * vthread)
 	  ("bad vthread or vthread->team in nested groups"));
 
   pool = vthread->team->task_pool;
+  vthread->fuzzy_barrier = 0;
 
-  max_count = __omp_spin_count;
   vthread->thr_ibar_state_id++;
   __ompc_ompt_set_state(THR_IBAR_STATE, ompt_state_wait_barrier_implicit, (ompt_wait_id_t) pool);
   __ompc_ompt_event_callback(OMP_EVENT_THR_BEGIN_IBAR, ompt_event_barrier_begin);
@@ -1155,26 +1326,18 @@ __ompc_exit_barrier(omp_v_thread_t * vthread)
   __ompt_event_callback(ompt_event_wait_barrier_begin);
 #endif
 
-  for (counter = 0; (*bar_count < team_size) ||
-          __ompc_task_pool_num_pending_tasks(pool); counter++) {
+  __ompc_spin_init(&spin);
+  while ((*bar_count < team_size) ||
+          __ompc_task_pool_num_pending_tasks(pool)) {
 
       while (__ompc_task_pool_num_pending_tasks(pool) &&
              (next = __ompc_remove_task_from_pool(pool))) {
           if (next != NULL)
               __ompc_task_switch(next);
       }
-      if (counter > max_count) {
-          pthread_mutex_lock(&pool->pool_lock);
-          if (__ompc_task_pool_num_pending_tasks(pool) == 0 &&
-                  *bar_count < team_size) {
-              struct timespec ts;
-              clock_gettime(CLOCK_REALTIME, &ts);
-              ts.tv_nsec += __omp_wait_time;
-              pthread_cond_timedwait(&pool->pool_cond,
-                                     &pool->pool_lock,
-                                     &ts);
-          }
-          pthread_mutex_unlock(&pool->pool_lock);
+      if (!__ompc_spin(&spin)) {
+          /* new tasks wake us up, arrivals are seen after wait_time */
+          __ompc_task_pool_idle_wait(pool, __omp_wait_time);
       }
   }
 
@@ -1186,23 +1349,10 @@ __ompc_exit_barrier(omp_v_thread_t * vthread)
 
   if (__omp_myid == 0) {
     if (myrank != team_size)
-    {
-      for( counter = 0; *exit_count != team_size; counter++) {
-        if (counter > max_count) {
-          pthread_mutex_lock(&vthread->team->barrier_lock);
-          while (*exit_count != team_size)
-            pthread_cond_wait(&vthread->team->barrier_cond,
-                              &vthread->team->barrier_lock);
-          pthread_mutex_unlock(&vthread->team->barrier_lock);
-        }
-      }
-    }
+      __ompc_wait_eq(exit_count, team_size, &vthread->team->barrier_sleepers);
   } else if (myrank == team_size ) {
-    // here we do need the mutex lock! otherwise,
-    // Otherwise, it's possible that cond_signal may fail to wake up the master thread.
-    pthread_mutex_lock(&vthread->team->barrier_lock);
-    pthread_cond_signal(&vthread->team->barrier_cond);
-    pthread_mutex_unlock(&vthread->team->barrier_lock);
+    /* the last one to arrive wakes up the master */
+    __ompc_wake(exit_count, &vthread->team->barrier_sleepers);
   }
 
 #ifdef OMPT
@@ -1212,16 +1362,151 @@ __ompc_exit_barrier(omp_v_thread_t * vthread)
   __ompc_ompt_event_callback(OMP_EVENT_THR_END_IBAR, ompt_event_barrier_end);
 }
 
+/* Allocate the go flag a level-1 worker is released with */
+static omp_fork_flag_t *
+__ompc_new_fork_flag(void)
+{
+  omp_fork_flag_t *flag;
+
+  flag = aligned_malloc(sizeof(omp_fork_flag_t), CACHE_LINE_SIZE);
+  Is_True(flag != NULL, ("Cannot allocate fork flag"));
+  flag->go = 0;
+  flag->sleeping = 0;
+  flag->joined = 0;
+  return flag;
+}
+
+/* Release the children of vthread_id in the fork tree. Every released
+ * worker releases its own children first, so the whole team is started
+ * in log(n) steps and each worker only polls its own cache line.
+ */
+static inline void
+__ompc_level_1_release_children(int vthread_id, int go, int release_size)
+{
+  int child, last_child;
+  omp_fork_flag_t *flag;
+
+  child = vthread_id * OMP_FORK_TREE_RADIX + 1;
+  last_child = child + OMP_FORK_TREE_RADIX;
+  if (last_child > release_size)
+    last_child = release_size;
+
+  for (; child < last_child; child++) {
+    flag = __omp_level_1_team[child].fork_flag;
+    flag->go = go;
+    __ompc_wake(&flag->go, &flag->sleeping);
+  }
+}
+
+/* Start a new fork generation for the first release_size level-1
+ * threads. Called by the master only.
+ */
+static void
+__ompc_level_1_release(int release_size)
+{
+  int go;
+
+  __omp_level_1_release_size = release_size;
+  go = ++(__omp_level_1_team_manager.new_task);
+  __ompc_mfence();
+  __ompc_level_1_release_children(0, go, release_size);
+}
+
+/* Wait until the threads released by the last fork have left its
+ * join. The join may be a full barrier (dissem), so a slave can still
+ * be reading the team barrier state after the master got through it;
+ * this must be called before that state is rebuilt or moved.
+ */
+static void
+__ompc_level_1_wait_joined(void)
+{
+  int i;
+  int go = __omp_level_1_team_manager.new_task;
+
+  for (i = 1; i < __omp_level_1_release_size; i++)
+    OMPC_WAIT_WHILE(__omp_level_1_team[i].fork_flag->joined != go);
+}
+
+/* Create a slave running entry(arg) on a stack of __omp_stack_size from
+ * stack_alloc(), with a guard page below it. The stack is kept in
+ * u_thread->stack_pointer and lives as long as the slave: level-1
+ * slaves run till exit, and nested workers are recycled through
+ * __omp_nested_pool together with their stacks.
+ */
+static void
+__ompc_create_slave(omp_u_thread_t *u_thread, pthread_t *uthread_id,
+                    int detached, pthread_entry entry, void *arg)
+{
+  pthread_attr_t attr;
+  size_t page = getpagesize();
+  size_t size = (__omp_stack_size + page - 1) & ~(page - 1);
+  int return_value;
+
+  u_thread->stack_pointer = stack_alloc(size, page);
+  Is_True(u_thread->stack_pointer != NULL,
+          ("Cannot allocate stack for thread"));
+
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  if (detached)
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  return_value = pthread_attr_setstack(&attr, u_thread->stack_pointer, size);
+  Is_True(return_value == 0, ("Cannot set stack for thread"));
+
+  return_value = pthread_create(uthread_id, &attr, entry, arg);
+  Is_True(return_value == 0, ("Cannot create more pthreads"));
+  pthread_attr_destroy(&attr);
+}
+
+/* Create the level-1 slaves lo .. hi-1 as a spawn tree. The caller
+ * creates the middle slave, hands it the upper half of the range and
+ * goes on with the lower half; each new slave does the same with the
+ * range it was handed. The team is up after O(log n) rounds of
+ * pthread_create instead of n.
+ * The v_threads and fork flags of the range must be set up already.
+ */
+static void
+__ompc_level_1_spawn(int lo, int hi)
+{
+  pthread_t uthread_id;
+  int mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    __omp_level_1_pthread[mid].spawn_end = hi;
+    __ompc_create_slave(&__omp_level_1_pthread[mid], &uthread_id, 0,
+                        (pthread_entry) __ompc_level_1_slave,
+                        (void *)((unsigned long int)mid));
+    hi = mid;
+  }
+}
+
 /* The thread function for level_1 slaves*/
 void*
 __ompc_level_1_slave(void * _uthread_index)
 {
   long uthread_index;
-  long int counter;
-  int new_tasks = __omp_level_1_team_manager.new_task;
-  __omp_seed = uthread_index;
+  omp_u_thread_t *u_thread;
+  omp_fork_flag_t *fork_flag;
+  int go = 0;
   uthread_index = (long) _uthread_index;
+  __omp_seed = uthread_index;
   __omp_myid = uthread_index;
+  fork_flag = __omp_level_1_team[uthread_index].fork_flag;
+
+  /* the creator does not touch the u_thread after pthread_create */
+  u_thread = &__omp_level_1_pthread[uthread_index];
+  u_thread->uthread_id = pthread_self();
+#ifndef TARG_LOONGSON
+  if (__omp_set_affinity) {
+    // bind to a specific cpu, the slaves we create inherit it till they
+    // bind themselves
+    __ompc_bind_pthread_to_cpu(u_thread->uthread_id, uthread_index);
+  }
+#endif //TARG_LOONGSON
+  stack_prefault(OMP_STACK_PREFAULT_SIZE);
+  __ompc_level_1_spawn(uthread_index + 1, u_thread->spawn_end);
+  __ompc_insert_into_hash_table(u_thread);
 
 #ifdef OMPT
   int __ompt_visit_events_after_init = 1;
@@ -1241,16 +1526,12 @@ __ompc_level_1_slave(void * _uthread_index)
   for(;;) {
 
 
-    for( counter = 0; __omp_level_1_team_manager.new_task == new_tasks;
-         counter++) {
-      if (counter > __omp_spin_count) {
-        pthread_mutex_lock(&__omp_level_1_mutex);
-        while (__omp_level_1_team_manager.new_task == new_tasks) {
-          pthread_cond_wait(&__omp_level_1_cond, &__omp_level_1_mutex);
-        }
-        pthread_mutex_unlock(&__omp_level_1_mutex);
-      }
-    }
+    __ompc_wait_ne(&fork_flag->go, go, &fork_flag->sleeping);
+
+    /* update go with current generation, and pass it down the tree */
+    go = fork_flag->go;
+    __ompc_level_1_release_children(uthread_index, go,
+                                    __omp_level_1_release_size);
 
 #ifdef OMPT
     if(__ompt_visit_events_after_init == 1) {
@@ -1260,13 +1541,10 @@ __ompc_level_1_slave(void * _uthread_index)
     	  __ompt_event_callback(ompt_event_idle_begin);
 //    	  __ompc_atomic_inc(&__ompt_check_thread_idle_events_counter);
     	  __ompt_visit_events_after_init = 0;
-    	  continue;
+    	  /* go on with this generation, it may already carry work */
     }
 #endif
 
-    /* update new_tasks with current count */
-    new_tasks = __omp_level_1_team_manager.new_task;
-
     __omp_exe_mode = OMP_EXE_MODE_NORMAL;
 
     /* in case level 1 team expanded and the user threads were allocated
@@ -1312,6 +1590,9 @@ __ompc_level_1_slave(void * _uthread_index)
       __omp_exe_mode = OMP_EXE_MODE_SEQUENTIAL;
     }
 
+    /* done with the team of this generation */
+    fork_flag->joined = go;
+
   }
 
 
@@ -1327,75 +1608,301 @@ __ompc_level_1_slave(void * _uthread_index)
   return NULL;
 }
 
-/* The thread function for nested slaves*/
+/* The thread function for nested slaves. The worker stays in
+ * __omp_nested_pool between nested regions and is started again
+ * by bumping its go flag.
+ */
 void*
-__ompc_nested_slave(void * _v_thread)
+__ompc_nested_slave(void * _worker)
 {
-  int counter;
-  omp_v_thread_t * my_vthread = (omp_v_thread_t *) _v_thread;
-  /* need to wait for others ready? */
+  omp_nested_worker_t *worker = (omp_nested_worker_t *) _worker;
+  omp_v_thread_t * my_vthread = &worker->vthread;
+  int go = 0;
 
-  __omp_current_v_thread = _v_thread;
+  stack_prefault(OMP_STACK_PREFAULT_SIZE);
 
-  __omp_exe_mode = OMP_EXE_MODE_NESTED;
+//#ifdef OMPT
+//  __ompt_event_callback(ompt_event_thread_begin);
+//#endif
 
-  __omp_myid = my_vthread->vthread_id;
+  for (;;) {
 
-  /* initialize implicit task for nested slave */
-  if (my_vthread->implicit_task == NULL) {
-    my_vthread->implicit_task = __ompc_task_new_implicit();
-  }
+    __ompc_wait_ne(&worker->go, go, &worker->sleeping);
+    go = worker->go;
 
-  __omp_current_task = my_vthread->implicit_task;
+    if (__omp_exit_now == 1)
+      break;
 
-  __ompc_ompt_set_state(THR_IDLE_STATE, ompt_state_idle, 0);
-  /* printf("IDLE called from nested\n"); */
+    __omp_current_v_thread = my_vthread;
 
-//#ifdef OMPT
-//  __ompt_event_callback(ompt_event_thread_begin);
-//#endif
+    __omp_exe_mode = OMP_EXE_MODE_NESTED;
 
-  counter = 0;
-  for (counter = 0; my_vthread->team->new_task != 1; counter++) {
-      if (counter > __omp_spin_count) {
+    __omp_myid = my_vthread->vthread_id;
 
-          pthread_mutex_lock(&my_vthread->team->barrier_lock);
-          while (my_vthread->team->new_task != 1) {
-              pthread_cond_wait(&my_vthread->team->barrier_cond,
-                      &my_vthread->team->barrier_lock);
-          }
-          pthread_mutex_unlock(&my_vthread->team->barrier_lock);
-      }
-  }
+    /* initialize implicit task for nested slave */
+    if (my_vthread->implicit_task == NULL) {
+      my_vthread->implicit_task = __ompc_task_new_implicit();
+    }
 
-  /* The relationship between vthread, uthread, and team should be OK here*/
+    __omp_current_task = my_vthread->implicit_task;
 
-  __ompc_ompt_event_callback(OMP_EVENT_THR_END_IDLE, ompt_event_idle_end);
-  __ompc_ompt_set_state(THR_WORK_STATE, ompt_state_work_parallel, 0);
+    __ompc_ompt_set_state(THR_IDLE_STATE, ompt_state_idle, 0);
+    /* printf("IDLE called from nested\n"); */
+
+    /* The relationship between vthread, uthread, and team should be OK here*/
+
+    __ompc_ompt_event_callback(OMP_EVENT_THR_END_IDLE, ompt_event_idle_end);
+    __ompc_ompt_set_state(THR_WORK_STATE, ompt_state_work_parallel, 0);
 
 
 #ifdef OMPT
-  __omp_current_task->frame_s.exit_runtime_frame = __builtin_frame_address(0);
+    __omp_current_task->frame_s.exit_runtime_frame = __builtin_frame_address(0);
 #endif
 
-  my_vthread->entry_func(my_vthread->vthread_id,
-      (char *)my_vthread->frame_pointer);
+    my_vthread->entry_func(my_vthread->vthread_id,
+        (char *)my_vthread->frame_pointer);
 
 #ifdef OMPT
-  __omp_current_task->frame_s.reenter_runtime_frame = __builtin_frame_address(0);
+    __omp_current_task->frame_s.reenter_runtime_frame = __builtin_frame_address(0);
 #endif
 
+    /*TODO: fix the barrier call for nested threads*/
+    __ompc_exit_barrier(my_vthread);
+
+    __omp_exe_mode = OMP_EXE_MODE_NORMAL;
+    __omp_current_task = NULL;
+
+    /* the team may go away as soon as busy is cleared, it must not be
+     * touched after this point */
+    __ompc_mfence();
+    worker->busy = 0;
+    __ompc_wake(&worker->busy, &worker->busy_sleepers);
+  }
+
 //#ifdef OMPT
 //  __ompt_event_callback(ompt_event_thread_end);
 //#endif
 
+  return NULL;
+}
+
+/* Start a parked nested worker on the region set up in its vthread */
+static inline void
+__ompc_nested_worker_start(omp_nested_worker_t *worker)
+{
+  worker->busy = 1;
+  __ompc_mfence();
+  worker->go++;
+  __ompc_wake(&worker->go, &worker->sleeping);
+}
+
+/* A new nested worker for nesting level 'level', already counted in the
+ * pool and against __omp_max_num_threads */
+static omp_nested_worker_t *
+__ompc_nested_worker_create(int level)
+{
+  omp_nested_worker_t *worker;
+
+  worker = aligned_malloc(sizeof(omp_nested_worker_t), CACHE_LINE_SIZE);
+  Is_True(worker != NULL, ("Cannot allocate nested worker"));
+  memset(worker, 0, sizeof(omp_nested_worker_t));
+  worker->level = level;
+
+  worker->uthread.hash_next = NULL;
+  worker->uthread.task = &worker->vthread;
+  worker->vthread.executor = &worker->uthread;
+  worker->vthread.implicit_task = NULL;
 
-  /*TODO: fix the barrier call for nested threads*/
-  __ompc_exit_barrier(my_vthread);
+  __ompc_create_slave(&worker->uthread, &worker->uthread.uthread_id, 1,
+                      (pthread_entry) __ompc_nested_slave, (void *) worker);
 
-  __omp_exe_mode = OMP_EXE_MODE_NORMAL;
+  // TODO: may need to bind pthread to a specific cpu for nested threads
 
-  pthread_exit(NULL);
+  return worker;
+}
+
+/* Get num_workers workers for nesting level 'level' into workers[]:
+ * parked ones of the pool first, then new ones as far as
+ * __omp_max_num_threads allows. They are all claimed under the pool
+ * lock, so that sibling nested forks cannot count the same ones.
+ * Returns how many there are, fewer than asked at the thread limit.
+ */
+static int
+__ompc_nested_pool_reserve(int level, omp_nested_worker_t **workers,
+                           int num_workers)
+{
+  omp_nested_pool_t *pool;
+  int num_got, num_new, i;
+
+  pthread_mutex_lock(&__omp_nested_pool_lock);
+  if (level >= __omp_nested_pool_levels) {
+    int new_levels = level + 1;
+    pool = realloc(__omp_nested_pool, sizeof(omp_nested_pool_t) * new_levels);
+    Is_True(pool != NULL, ("Cannot allocate nested thread pool"));
+    memset(pool + __omp_nested_pool_levels, 0,
+           sizeof(omp_nested_pool_t) * (new_levels - __omp_nested_pool_levels));
+    __omp_nested_pool = pool;
+    __omp_nested_pool_levels = new_levels;
+  }
+  pool = &__omp_nested_pool[level];
+  for (num_got = 0; num_got < num_workers && pool->free_list != NULL;
+       num_got++) {
+    workers[num_got] = pool->free_list;
+    pool->free_list = workers[num_got]->next;
+    pool->num_idle--;
+  }
+  num_new = num_workers - num_got;
+  if (num_new > __omp_max_num_threads)
+    num_new = __omp_max_num_threads;
+  pool->num_workers += num_new;
+  __omp_max_num_threads -= num_new;
+  pthread_mutex_unlock(&__omp_nested_pool_lock);
+
+  for (i = num_got; i < num_got + num_new; i++)
+    workers[i] = __ompc_nested_worker_create(level);
+
+  return num_got + num_new;
+}
+
+/* A team for a nested region of team_size threads at 'level': a shell
+ * of a finished region of the same size if the pool has one, with its
+ * task pool, locks and xbarrier info ready for use, or a new one.
+ */
+static omp_team_t *
+__ompc_nested_team_get(int level, int team_size)
+{
+  omp_team_t *team, **prev;
+  omp_nested_pool_t *pool;
+  int k, log2_team_size;
+
+  team = NULL;
+  pthread_mutex_lock(&__omp_nested_pool_lock);
+  if (level < __omp_nested_pool_levels) {
+    pool = &__omp_nested_pool[level];
+    for (prev = &pool->free_teams; *prev != NULL;
+         prev = &(*prev)->next_shell) {
+      if ((*prev)->team_size == team_size) {
+        team = *prev;
+        *prev = team->next_shell;
+        pool->num_free_teams--;
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&__omp_nested_pool_lock);
+
+  if (team != NULL) {
+    /* O64_OMP_XBARRIER_TYPE=auto may have switched algorithm since */
+    if (team->xbarrier_type != __omp_xbarrier_type) {
+      __ompc_xbarrier_info_destroy(team);
+      __ompc_xbarrier_info_create(team);
+    } else {
+      __ompc_xbarrier_info_init(team);
+    }
+    return team;
+  }
+
+  log2_team_size = 0;
+  for(k = 1; k < team_size; log2_team_size++, k <<= 1);
+
+  team = aligned_malloc(sizeof(omp_team_t), CACHE_LINE_SIZE);
+  Is_True(team != NULL, ("Cannot allocate nested team"));
+  memset(team, 0, sizeof(omp_team_t));
+
+  team->team_size = team_size;
+  team->is_nested = 1;
+  team->team_level = level;
+  team->log2_team_size = log2_team_size;
+
+  /* create task pool for nested team */
+  team->task_pool = __ompc_create_task_pool(team_size);
+
+  __ompc_xbarrier_info_create(team);
+
+  __ompc_init_spinlock(&(team->schedule_lock));
+  pthread_cond_init(&(team->ordered_cond), NULL);
+  pthread_mutex_init(&(team->barrier_lock), NULL);
+  pthread_cond_init(&(team->barrier_cond), NULL);
+
+  return team;
+}
+
+static void
+__ompc_nested_team_destroy(omp_team_t *team)
+{
+  __ompc_destroy_task_pool(team->task_pool);
+
+  /* destroy xbarrier info for team */
+  __ompc_xbarrier_info_destroy(team);
+
+  __ompc_destroy_spinlock(&(team->schedule_lock));
+  pthread_cond_destroy(&(team->ordered_cond));
+  pthread_mutex_destroy(&(team->barrier_lock));
+  pthread_cond_destroy(&(team->barrier_cond));
+
+  aligned_free(team);
+}
+
+/* Keep the team of a finished nested region for the next one, or free
+ * it when the pool of its level already holds enough of them.
+ */
+static void
+__ompc_nested_team_put(omp_team_t *team)
+{
+  omp_nested_pool_t *pool;
+
+  pthread_mutex_lock(&__omp_nested_pool_lock);
+  /* the workers of the team made sure the level exists */
+  pool = &__omp_nested_pool[team->team_level];
+  if (pool->num_free_teams < OMP_NESTED_TEAM_CACHE_SIZE) {
+    team->next_shell = pool->free_teams;
+    pool->free_teams = team;
+    pool->num_free_teams++;
+    team = NULL;
+  }
+  pthread_mutex_unlock(&__omp_nested_pool_lock);
+
+  if (team != NULL)
+    __ompc_nested_team_destroy(team);
+}
+
+/* Return the workers of a finished nested team to the pool */
+static void
+__ompc_nested_pool_put(omp_nested_worker_t **workers, int num_workers)
+{
+  int i;
+  omp_nested_pool_t *pool;
+
+  if (num_workers == 0)
+    return;
+
+  pthread_mutex_lock(&__omp_nested_pool_lock);
+  for (i = 0; i < num_workers; i++) {
+    pool = &__omp_nested_pool[workers[i]->level];
+    workers[i]->next = pool->free_list;
+    pool->free_list = workers[i];
+    pool->num_idle++;
+  }
+  pthread_mutex_unlock(&__omp_nested_pool_lock);
+}
+
+/* Wake up every parked nested worker so that it can exit. The workers
+ * only touch their own omp_nested_worker_t on the way out, so there is
+ * no need to wait for them. */
+static void
+__ompc_nested_pool_shutdown(void)
+{
+  int level;
+  omp_nested_worker_t *worker;
+
+  pthread_mutex_lock(&__omp_nested_pool_lock);
+  for (level = 0; level < __omp_nested_pool_levels; level++) {
+    for (worker = __omp_nested_pool[level].free_list; worker != NULL;
+         worker = worker->next) {
+      __ompc_nested_worker_start(worker);
+    }
+  }
+  pthread_mutex_unlock(&__omp_nested_pool_lock);
 }
 
 void
@@ -1406,24 +1913,29 @@ __ompc_fini_rtl(void)
 #endif
 
 	__omp_exit_now = 1;
-    if (__omp_level_1_team_size > 1) {
+    if (__omp_level_1_team_alloc_size > 1) {
       /* Before signal, should make sure that all slaves are ready*/
-      pthread_mutex_lock(&__omp_level_1_mutex);
-      (__omp_level_1_team_manager.new_task)++;
-      pthread_cond_broadcast(&__omp_level_1_cond);
-      pthread_mutex_unlock(&__omp_level_1_mutex);
+      __ompc_level_1_release(__omp_level_1_team_alloc_size);
     }
 
     OMPC_WAIT_WHILE(__omp_level_1_pthread_count != 1);
 
+  __ompc_nested_pool_shutdown();
+
   __ompc_destroy_task_pool(__omp_level_1_team_manager.task_pool);
   __ompc_xbarrier_info_destroy(&__omp_level_1_team_manager);
 
   /* clean up job*/
-  if (__omp_level_1_team != NULL)
+  if (__omp_level_1_team != NULL) {
+    int i;
+    for (i=0; i<__omp_level_1_team_alloc_size; i++)
+      aligned_free(__omp_level_1_team[i].fork_flag);
     aligned_free(__omp_level_1_team);
+  }
   if (__omp_level_1_pthread != NULL)
     aligned_free(__omp_level_1_pthread);
+  if (__omp_uthread_hash_table != NULL)
+    aligned_free(__omp_uthread_hash_table);
 
   /* Other mutex, conditions, locks , should be destroyed here*/
   if (__omp_list_processors != NULL)
@@ -1438,7 +1950,6 @@ __ompc_init_rtl(int num_threads)
   int threads_to_create, log2_threads_to_create;
   int i, j, k, d; 
 
-  int return_value;
   void *stack_pointer;
 
   Is_True(__omp_rtl_initialized == 0, 
@@ -1474,23 +1985,19 @@ __ompc_init_rtl(int num_threads)
   /* determine number of threads to create*/
   threads_to_create = num_threads == 0 ? __omp_nthreads_var : num_threads;
 
-  log2_threads_to_create = 0;
-  for(k = 1; k < threads_to_create; log2_threads_to_create++, k <<= 1);
-
   /* keep it as nthreads-var suggested in spec. Liao */
   __omp_nthreads_var = threads_to_create;
 
-  /* setup pthread attributes */
-  pthread_attr_init(&__omp_pthread_attr);
-  pthread_attr_setscope(&__omp_pthread_attr, PTHREAD_SCOPE_SYSTEM);
-  /* need to set up barrier attributes */
+  /* only the master for now, the first fork expands the team to the
+     size it asks for */
+  if (__omp_lazy_create && num_threads == 0)
+    threads_to_create = 1;
+
+  log2_threads_to_create = 0;
+  for(k = 1; k < threads_to_create; log2_threads_to_create++, k <<= 1);
 
   /* initial global locks*/
-  pthread_mutex_init(&__omp_level_1_mutex, NULL);
-  pthread_mutex_init(&__omp_level_1_barrier_mutex, NULL);
   pthread_mutex_init(&__omp_hash_table_lock, NULL);
-  pthread_cond_init(&__omp_level_1_cond, NULL);
-  pthread_cond_init(&__omp_level_1_barrier_cond, NULL);
   __ompc_init_spinlock(&_ompc_thread_lock);
 
 
@@ -1500,8 +2007,8 @@ __ompc_init_rtl(int num_threads)
   __omp_myid = 0;
   __omp_seed = 0;
 
-  /* clean up uthread hash table */
-  __ompc_clear_hash_table();
+  /* allocate and clean up uthread hash table */
+  __ompc_resize_hash_table(threads_to_create);
 
 
   /* create level 1 team */
@@ -1521,6 +2028,10 @@ __ompc_init_rtl(int num_threads)
   __omp_level_1_team_manager.barrier_count = 0;
   __omp_level_1_team_manager.barrier_count2 = 0;
   __omp_level_1_team_manager.exit_count = 0;
+  __omp_level_1_team_manager.barrier_sleepers = 0;
+  __omp_level_1_team_manager.split_count = 0;
+  __omp_level_1_team_manager.split_phase = 0;
+  __omp_level_1_team_manager.split_sleepers = 0;
   __omp_level_1_team_manager.barrier_flag = 0;
   __omp_level_1_team_manager.single_count = 0;
   __omp_level_1_team_manager.new_task = 0;
@@ -1539,7 +2050,6 @@ __ompc_init_rtl(int num_threads)
 
   __ompc_init_spinlock(&(__omp_level_1_team_manager.schedule_lock));
   pthread_cond_init(&(__omp_level_1_team_manager.ordered_cond), NULL);
-  __ompc_init_lock(&(__omp_level_1_team_manager.single_lock));
   pthread_mutex_init(&(__omp_level_1_team_manager.barrier_lock), NULL);
   pthread_cond_init(&(__omp_level_1_team_manager.barrier_cond), NULL);
 	
@@ -1568,6 +2078,8 @@ __ompc_init_rtl(int num_threads)
     __ompc_init_xbarrier_local_info(&__omp_level_1_team[i].xbarrier_local,
          i, &__omp_level_1_team_manager);
 
+    __omp_level_1_team[i].fork_flag = __ompc_new_fork_flag();
+
     /* the corresponding relationship is fixed*/
     __omp_level_1_team[i].executor = &(__omp_level_1_pthread[i]);
     __omp_level_1_pthread[i].task = &(__omp_level_1_team[i]);
@@ -1606,7 +2118,7 @@ __ompc_init_rtl(int num_threads)
 #ifndef TARG_LOONGSON
   if (__omp_set_affinity) {
     //bind the current thread to the first available cpu 
-    __ompc_bind_pthread_to_cpu(__omp_root_thread_id);
+    __ompc_bind_pthread_to_cpu(__omp_root_thread_id, 0);
   }
 #endif //TARG_LOONGSON
 
@@ -1639,29 +2151,8 @@ __ompc_init_rtl(int num_threads)
   }
 #endif
 
-  for (i=1; i< threads_to_create; i++) {
-
-#ifndef TARG_LOONGSON
-    return_value = pthread_attr_setstacksize(&__omp_pthread_attr, __omp_stack_size);
-    Is_True(return_value == 0, ("Cannot set stack size for thread"));
-#endif //TARG_LOONGSON
-    return_value = pthread_create( &(__omp_level_1_pthread[i].uthread_id),
-				   &__omp_pthread_attr, (pthread_entry) __ompc_level_1_slave, 
-				   (void *)((unsigned long int)i));
-    Is_True(return_value == 0, ("Cannot create more pthreads"));
-
-    __omp_level_1_pthread[i].stack_pointer = (char *)0;
-
-#ifndef TARG_LOONGSON
-    if (__omp_set_affinity) {
-      // bind pthread to a specific cpu
-      __ompc_bind_pthread_to_cpu(__omp_level_1_pthread[i].uthread_id);
-    }
-#endif //TARG_LOONGSON
-
-    __ompc_insert_into_hash_table(&(__omp_level_1_pthread[i]));
-
-  }
+  /* slaves bind and hash themselves */
+  __ompc_level_1_spawn(1, threads_to_create);
 
   OMPC_WAIT_WHILE(__omp_level_1_pthread_count != threads_to_create);	
 
@@ -1681,10 +2172,7 @@ __ompc_init_rtl(int num_threads)
 
 		if (__omp_level_1_team_size > 1) {
 			/* Before signal, should make sure that all slaves are ready*/
-			pthread_mutex_lock(&__omp_level_1_mutex);
-			(__omp_level_1_team_manager.new_task)++;
-			pthread_cond_broadcast(&__omp_level_1_cond);
-			pthread_mutex_unlock(&__omp_level_1_mutex);
+			__ompc_level_1_release(__omp_level_1_team_size);
 
 //			OMPC_WAIT_WHILE(__ompt_check_thread_idle_events_counter != __omp_level_1_team_size - 1);
 		}
@@ -1694,6 +2182,45 @@ __ompc_init_rtl(int num_threads)
   return threads_to_create;
 }
 
+/* Make sure the uthread hash table has at least num_threads buckets
+ * (power of 2, never below UTHREAD_HASH_SIZE_MIN). Existing entries
+ * are rehashed into the new table. */
+void
+__ompc_resize_hash_table(int num_threads)
+{
+  omp_u_thread_t **new_table;
+  omp_u_thread_t *uthread, *next;
+  unsigned long int new_size, i;
+  int hash_index;
+
+  new_size = UTHREAD_HASH_SIZE_MIN;
+  while (new_size < num_threads)
+    new_size <<= 1;
+  if (new_size <= __omp_uthread_hash_size)
+    return;
+
+  new_table = aligned_malloc(sizeof(omp_u_thread_t *) * new_size,
+                             CACHE_LINE_SIZE);
+  Is_True(new_table != NULL, ("Can't allocate uthread hash table"));
+  memset(new_table, 0, sizeof(omp_u_thread_t *) * new_size);
+
+  pthread_mutex_lock(&__omp_hash_table_lock);
+  for (i = 0; i < __omp_uthread_hash_size; i++) {
+    for (uthread = __omp_uthread_hash_table[i]; uthread != NULL;
+         uthread = next) {
+      next = uthread->hash_next;
+      hash_index = HASH_IDX(uthread->uthread_id, new_size);
+      uthread->hash_next = new_table[hash_index];
+      new_table[hash_index] = uthread;
+    }
+  }
+  if (__omp_uthread_hash_table != NULL)
+    aligned_free(__omp_uthread_hash_table);
+  __omp_uthread_hash_table = new_table;
+  __omp_uthread_hash_size = new_size;
+  pthread_mutex_unlock(&__omp_hash_table_lock);
+}
+
 /* Expand level_1_team to new_num_threads.
    The caller must make sure the validity of new_num_threads. */
 
@@ -1701,7 +2228,6 @@ void
 __ompc_expand_level_1_team(int new_num_threads)
 {
   int i;
-  int return_value;
   int k, new_log2_num_threads;
   omp_u_thread_t *new_u_team;
   omp_v_thread_t *new_v_team;
@@ -1711,6 +2237,8 @@ __ompc_expand_level_1_team(int new_num_threads)
   new_log2_num_threads = 0;
   for(k = 1; k < new_num_threads; new_log2_num_threads++, k <<= 1);
 
+  __ompc_resize_hash_table(new_num_threads);
+
   new_u_team = (omp_u_thread_t *) aligned_realloc((void *) __omp_level_1_pthread,
                         sizeof(omp_u_thread_t) * __omp_level_1_team_alloc_size, 
                         sizeof(omp_u_thread_t) * new_num_threads,
@@ -1806,26 +2334,12 @@ __ompc_expand_level_1_team(int new_num_threads)
     __ompc_init_xbarrier_local_info(&__omp_level_1_team[i].xbarrier_local,
                                     i, &__omp_level_1_team_manager);
 
-    /* for u_thread */
-    return_value = pthread_attr_setstacksize(&__omp_pthread_attr, __omp_stack_size);
-    Is_True(return_value == 0, ("Cannot set stack size for thread"));
-    return_value = pthread_create( &(__omp_level_1_pthread[i].uthread_id),
-				   &__omp_pthread_attr, (pthread_entry) __ompc_level_1_slave, 
-				   (void *)((unsigned long int)i));
-    Is_True(return_value == 0, ("Cannot create more pthreads"));
-
-    __omp_level_1_pthread[i].stack_pointer = (char *)0;
-
-#ifndef TARG_LOONGSON
-    if (__omp_set_affinity) {
-      // bind pthread to a specific cpu
-      __ompc_bind_pthread_to_cpu(__omp_level_1_pthread[i].uthread_id);
-    }
-#endif //TARG_LOONGSON
-
-    __ompc_insert_into_hash_table(&(__omp_level_1_pthread[i]));
+    __omp_level_1_team[i].fork_flag = __ompc_new_fork_flag();
   }
 
+  /* for u_thread, slaves bind and hash themselves */
+  __ompc_level_1_spawn(__omp_level_1_team_alloc_size, new_num_threads);
+
   OMPC_WAIT_WHILE(__omp_level_1_pthread_count != new_num_threads);	
   /* We still should make sure that all the slaves are ready*/
   /* TODO: wait for all slaves*/
@@ -1844,19 +2358,16 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
 	    frame_pointer_t frame_pointer)
 {
   int i;
-  int return_value;
   int k, log2_num_threads;
   int num_threads = _num_threads;
-  omp_team_t temp_team;
+  omp_team_t *nested_team;
   omp_v_thread_t temp_v_thread;
-  omp_v_thread_t *nest_v_thread_team;
-  omp_u_thread_t *nest_u_thread_team;
+  omp_nested_worker_t **nest_workers;
   omp_u_thread_t *current_u_thread;
   omp_v_thread_t *original_v_thread;
   omp_task_t *original_task;
   void * stack_pointer;
   unsigned int region_used = 0; // TODO: make it one-bit.
-  pthread_attr_t nested_pthread_attr;
 
 
 #if  !(defined TARG_LOONGSON || defined _UH_COARRAYS)
@@ -1872,7 +2383,26 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
   if (num_threads != 0) 
     num_threads = __ompc_check_num_threads(num_threads);
 
+  if (!(__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL) && __omp_nested == 1) {
+    if (num_threads == 0) num_threads = __omp_nthreads_var;
+
+    if (__omp_dynamic)
+      num_threads = __ompc_dynamic_num_threads(num_threads);
+  }
+
   if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL) {
+    // Adjust the number of the number of thread in the team
+    if (num_threads == 0) {
+     /* use default thread number decided from processor number and environment variable*/
+      num_threads = __omp_nthreads_var;
+    }
+
+    if (__omp_dynamic)
+      num_threads = __ompc_dynamic_num_threads(num_threads);
+
+    if (__omp_xbarrier_auto)
+      __ompc_xbarrier_calibrate(num_threads);
+
     __omp_exe_mode = OMP_EXE_MODE_NORMAL;
     /* level 1 thread fork */
     /* How about num_threads < __omp_level_1_team_size */
@@ -1902,54 +2432,49 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
     pthread_mutex_unlock(&region_counter_mutex);
 #endif
 
-    // Adjust the number of the number of thread in the team
-    if (num_threads == 0) {
-     /* use default thread number decided from processor number and environment variable*/
-      __omp_level_1_team_size = __omp_nthreads_var;
-      __omp_level_1_team_manager.team_size = __omp_nthreads_var;
-    } else {
-      // expand the team when there is not enough threads
-      if (num_threads > __omp_level_1_team_alloc_size) {
-        __ompc_expand_level_1_team(num_threads);
-        __omp_current_v_thread = &__omp_level_1_team[0];
-      }
-
-      if (num_threads != __omp_level_1_team_size) {
-        /* change in team size means xbarrier info needs to be reconstructed
-         */
-        //__ompc_xbarrier_info_destroy(&__omp_level_1_team_manager);
-
-        __omp_level_1_team_size = num_threads;
-        __omp_level_1_team_manager.team_size = num_threads;
-        log2_num_threads = 0;
-        for(k = 1; k < num_threads; log2_num_threads++, k <<= 1);
-        __omp_level_1_team_manager.log2_team_size = log2_num_threads;
-
-        /* init new xbarrier info with updated team_size */
-        __ompc_xbarrier_info_init(&__omp_level_1_team_manager);
+    if (num_threads != __omp_level_1_team_size)
+      __ompc_level_1_wait_joined();
 
-        /* need to reset per-thread xbarrier info for existing threads */
-        for (i=0; i<__omp_level_1_team_size; i++) {
-          __ompc_init_xbarrier_local_info(&__omp_level_1_team[i].xbarrier_local,
-                                          i, &__omp_level_1_team_manager);
-        }
+    // expand the team when there is not enough threads
+    if (num_threads > __omp_level_1_team_alloc_size) {
+      __ompc_expand_level_1_team(num_threads);
+      __omp_current_v_thread = &__omp_level_1_team[0];
+    }
 
-      } else {
-        __omp_level_1_team_size = num_threads;
-        __omp_level_1_team_manager.team_size = num_threads;
-        log2_num_threads = 0;
-        for(k = 1; k < num_threads; log2_num_threads++, k <<= 1);
-        __omp_level_1_team_manager.log2_team_size = log2_num_threads;
+    if (num_threads != __omp_level_1_team_size) {
+      /* change in team size means xbarrier info needs to be reconstructed
+       */
+      __ompc_xbarrier_info_destroy((omp_team_t *) &__omp_level_1_team_manager);
+
+      __omp_level_1_team_size = num_threads;
+      __omp_level_1_team_manager.team_size = num_threads;
+      log2_num_threads = 0;
+      for(k = 1; k < num_threads; log2_num_threads++, k <<= 1);
+      __omp_level_1_team_manager.log2_team_size = log2_num_threads;
+
+      /* create new xbarrier info with updated team_size */
+      __ompc_xbarrier_info_create((omp_team_t *) &__omp_level_1_team_manager);
+
+      /* need to reset per-thread xbarrier info for existing threads */
+      for (i=0; i<__omp_level_1_team_size; i++) {
+        __ompc_init_xbarrier_local_info(
+          &__omp_level_1_team[i].xbarrier_local, i,
+          (omp_team_t *) &__omp_level_1_team_manager);
       }
     }
 
     __ompc_task_pool_set_team_size( __omp_level_1_team_manager.task_pool,
                                     __omp_level_1_team_manager.team_size);
 
+    /* the copyprivate broadcasts of the last region are all consumed */
+    __omp_level_1_team_manager.cppriv_seq = 0;
+
     for (i=0; i<__omp_level_1_team_size; i++) {
       __omp_level_1_team[i].frame_pointer = frame_pointer;
       __omp_level_1_team[i].team_size = __omp_level_1_team_size;
       __omp_level_1_team[i].entry_func = micro_task;
+      __omp_level_1_team[i].cppriv_seq = 0;
+      __omp_level_1_team[i].fuzzy_barrier = 0;
 
 #ifdef OMPT
       __omp_level_1_team[i].type = ompt_thread_worker;
@@ -1961,10 +2486,7 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
 
     if (__omp_level_1_team_size > 1) {
       /* Before signal, should make sure that all slaves are ready*/
-      pthread_mutex_lock(&__omp_level_1_mutex);
-      (__omp_level_1_team_manager.new_task)++;
-      pthread_cond_broadcast(&__omp_level_1_cond);
-      pthread_mutex_unlock(&__omp_level_1_mutex);
+      __ompc_level_1_release(__omp_level_1_team_size);
     }
 
 
@@ -2022,71 +2544,57 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
     __omp_current_v_thread = &__omp_root_v_thread;
     __omp_current_task = NULL;
 
-  } else if (__omp_nested == 1) {
+  } else if (__omp_nested == 1 && num_threads > 1) {
     /* OMP_EXE_MODE_IN_PARALLEL, with nested enable */
     /* nested fork */
-    /* Maybe we should also ensure that teamsize != 1*/
-    int k, log2_num_threads;
     int orig_omp_myid = __omp_myid;
+    omp_exe_mode_t orig_exe_mode;
 
+    /* the outer team synchronizes before the nested one reads its data */
+    __ompc_fuzzy_barrier_resolve();
+    orig_exe_mode = __omp_exe_mode;
     __omp_exe_mode = OMP_EXE_MODE_NESTED;
 
     current_u_thread = __ompc_get_current_u_thread();
     original_v_thread = current_u_thread->task;
     original_task = __omp_current_task;
 
-    if (num_threads == 0) num_threads = __omp_nthreads_var;
+    /* nest_workers[0] is of no use, the master runs as itself */
+    nest_workers = alloca(sizeof(omp_nested_worker_t *) * num_threads);
+    i = __ompc_nested_pool_reserve(original_v_thread->team->team_level + 1,
+                                   nest_workers + 1, num_threads - 1);
+    if (i < num_threads - 1) {
+      Warning(" Exceed the thread number limit: Reduce to Max");
+      num_threads = i + 1;
+    }
 
-    log2_num_threads = 0;
-    for(k = 1; k < num_threads; log2_num_threads++, k <<= 1);
-
-    temp_team.team_size = num_threads;
-    temp_team.is_nested = 1;
-    temp_team.team_level = original_v_thread->team->team_level + 1;
-    temp_team.barrier_count = 0;
-    temp_team.barrier_count2 = 0;
-    temp_team.exit_count = 0;
-    temp_team.barrier_flag = 0;
-    temp_team.new_task = 0;
+    nested_team = __ompc_nested_team_get(
+                    original_v_thread->team->team_level + 1, num_threads);
+
+    nested_team->barrier_count = 0;
+    nested_team->barrier_count2 = 0;
+    nested_team->exit_count = 0;
+    nested_team->barrier_sleepers = 0;
+    nested_team->split_count = 0;
+    nested_team->split_phase = 0;
+    nested_team->split_sleepers = 0;
+    nested_team->barrier_flag = 0;
+    nested_team->new_task = 0;
     /* Used anywhere. obsoleted*/
-    temp_team.loop_count = 0;
-    temp_team.loop_info_size = 0;
-    temp_team.loop_info = NULL;
-    temp_team.single_count = 0;
-    temp_team.collector_task_id = 0;
-
-    temp_team.log2_team_size = log2_num_threads;
-
-    /* create task pool for nested team */
-    temp_team.task_pool = __ompc_create_task_pool(num_threads);
-
-    __ompc_xbarrier_info_create(&temp_team);
-
-    __ompc_init_spinlock(&(temp_team.schedule_lock));
-    pthread_cond_init(&(__omp_level_1_team_manager.ordered_cond), NULL);
-    __ompc_init_lock(&(temp_team.single_lock));
-    pthread_mutex_init(&(temp_team.barrier_lock), NULL);
-    pthread_cond_init(&(temp_team.barrier_cond), NULL);
-
-    nest_v_thread_team = aligned_malloc(sizeof(omp_v_thread_t) * num_threads, CACHE_LINE_SIZE); 
-    Is_True(nest_v_thread_team != NULL, 
-	    ("Cannot allocate nested v_thread team"));
-
-    /* nest_u_thread_team[0] is of no use currently*/
-    nest_u_thread_team = aligned_malloc(sizeof(omp_u_thread_t) * num_threads, CACHE_LINE_SIZE);
-    Is_True(nest_u_thread_team != NULL,
-	    ("Cannot allocate nested u_thread team"));
-
-    /* A lock is needed to protect global variables */
-    /* TODO: need a global lock*/
-    __omp_max_num_threads -= num_threads - 1;
+    nested_team->loop_count = 0;
+    nested_team->loop_info_size = 0;
+    nested_team->loop_info = NULL;
+    nested_team->single_count = 0;
+    nested_team->cppriv_counter = 0;
+    nested_team->cppriv_seq = 0;
+    nested_team->collector_task_id = 0;
 
 #ifdef OMPT
     pthread_mutex_lock(&region_counter_mutex);
-    __parallel_region_id_generator(&temp_team, __ompc_get_current_team());
+    __parallel_region_id_generator(nested_team, __ompc_get_current_team());
 
-    __ompt_parallel_region_id = temp_team.parallel_region_id;
-    __ompt_team_size = temp_team.team_size;
+    __ompt_parallel_region_id = nested_team->parallel_region_id;
+    __ompt_team_size = nested_team->team_size;
 
     __ompt_entry_func = micro_task;
 #endif
@@ -2098,84 +2606,75 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
     pthread_mutex_unlock(&region_counter_mutex);
 #endif
 
-    pthread_attr_init(&nested_pthread_attr);
-    pthread_attr_setscope(&nested_pthread_attr, PTHREAD_SCOPE_SYSTEM);
-    return_value = pthread_attr_setstacksize(&nested_pthread_attr,
-            __omp_stack_size);
-    Is_True(return_value == 0, ("Cannot set stack size for thread"));
     for (i=1; i<num_threads; i++) {
-      nest_v_thread_team[i].vthread_id = i;
-      nest_v_thread_team[i].single_count = 0;
-      nest_v_thread_team[i].loop_count = 0;
-      nest_v_thread_team[i].team = &temp_team;
-      nest_v_thread_team[i].team_size = num_threads;
-      nest_v_thread_team[i].entry_func = micro_task;
-      nest_v_thread_team[i].frame_pointer = frame_pointer;
-      nest_v_thread_team[i].executor = &(nest_u_thread_team[i]);
-
-      nest_u_thread_team[i].hash_next = NULL;
-      nest_u_thread_team[i].task = &(nest_v_thread_team[i]);
+      omp_nested_worker_t *worker;
+      omp_v_thread_t *nest_v_thread;
+
+      worker = nest_workers[i];
+      nest_v_thread = &worker->vthread;
+
+      nest_v_thread->vthread_id = i;
+      nest_v_thread->single_count = 0;
+      nest_v_thread->cppriv_seq = 0;
+      nest_v_thread->fuzzy_barrier = 0;
+      nest_v_thread->loop_count = 0;
+      nest_v_thread->team = nested_team;
+      nest_v_thread->team_size = num_threads;
+      nest_v_thread->entry_func = micro_task;
+      nest_v_thread->frame_pointer = frame_pointer;
 
       /* implicit task is created in __ompc_nested_slave */
-      nest_v_thread_team[i].implicit_task = NULL;
-      nest_v_thread_team[i].num_suspended_tied_tasks = 0;
+      nest_v_thread->implicit_task = NULL;
+      nest_v_thread->num_suspended_tied_tasks = 0;
 
 #ifdef OMPT
-      nest_v_thread_team[i].type = ompt_thread_worker;
+      nest_v_thread->type = ompt_thread_worker;
 #endif
 
-      __ompc_init_xbarrier_local_info(&nest_v_thread_team[i].xbarrier_local,
-                                     i, &temp_team);
-
-      return_value = pthread_create(&(nest_u_thread_team[i].uthread_id),
-				    &nested_pthread_attr, (pthread_entry) __ompc_nested_slave,
-				    (void *)(&(nest_v_thread_team[i])));
-      Is_True(return_value == 0, ("Cannot create more pthreads"));
-
-      nest_u_thread_team[i].stack_pointer = (char *)0;
-
-      // TODO: may need to bind pthread to a specific cpu for nested threads
+      __ompc_init_xbarrier_local_info(&nest_v_thread->xbarrier_local,
+                                     i, nested_team);
 
       /* hash table isn't really necessary if storing current v_thread in
        * __omp_current_v_thread.  */
-      //__ompc_insert_into_hash_table(&(nest_u_thread_team[i]));
-
+      //__ompc_insert_into_hash_table(&(worker->uthread));
     }
 
-    pthread_mutex_lock(&temp_team.barrier_lock);
-    temp_team.new_task = 1;
-    pthread_cond_broadcast(&temp_team.barrier_cond);
-    pthread_mutex_unlock(&temp_team.barrier_lock);
-
-    nest_v_thread_team[0].vthread_id = 0;
-    nest_v_thread_team[0].single_count = 0;
-    nest_v_thread_team[0].loop_count = 0;
-    nest_v_thread_team[0].team = &temp_team;
-    nest_v_thread_team[0].team_size = num_threads;
+    temp_v_thread.vthread_id = 0;
+    temp_v_thread.single_count = 0;
+    temp_v_thread.cppriv_seq = 0;
+    temp_v_thread.fuzzy_barrier = 0;
+    temp_v_thread.loop_count = 0;
+    temp_v_thread.team = nested_team;
+    temp_v_thread.team_size = num_threads;
     /* The following two maybe not important. */
-    nest_v_thread_team[0].entry_func = micro_task;
-    nest_v_thread_team[0].frame_pointer = frame_pointer;
-    nest_v_thread_team[0].executor = current_u_thread;
+    temp_v_thread.entry_func = micro_task;
+    temp_v_thread.frame_pointer = frame_pointer;
+    temp_v_thread.executor = current_u_thread;
+
+    temp_v_thread.implicit_task = NULL;
+    temp_v_thread.num_suspended_tied_tasks = 0;
 
-    nest_v_thread_team[0].implicit_task = NULL;
-    nest_v_thread_team[0].num_suspended_tied_tasks = 0;
+    __ompc_init_xbarrier_local_info(&temp_v_thread.xbarrier_local,
+                                   0, nested_team);
 
-    __ompc_init_xbarrier_local_info(&nest_v_thread_team[0].xbarrier_local,
-                                   0, &temp_team);
+    /* setting up the local info of a thread writes to the shared barrier
+     * state, so no worker may start before all of them are set up */
+    for (i=1; i<num_threads; i++)
+      __ompc_nested_worker_start(nest_workers[i]);
 
-    current_u_thread->task = &(nest_v_thread_team[0]);
+    current_u_thread->task = &temp_v_thread;
 
-    __omp_current_v_thread = &nest_v_thread_team[0];
+    __omp_current_v_thread = &temp_v_thread;
 #ifdef OMPT
-      nest_v_thread_team[0].type = ompt_thread_initial;
+      temp_v_thread.type = ompt_thread_initial;
 #endif
 
     /* initialize implicit task for master thread of nested team */
-    if (nest_v_thread_team[0].implicit_task == NULL) {
-      nest_v_thread_team[0].implicit_task = __ompc_task_new_implicit();
+    if (temp_v_thread.implicit_task == NULL) {
+      temp_v_thread.implicit_task = __ompc_task_new_implicit();
     }
 
-    __omp_current_task = nest_v_thread_team[0].implicit_task;
+    __omp_current_task = temp_v_thread.implicit_task;
 
     /* execution */
     /* A start barrier should also be presented here?*/
@@ -2194,7 +2693,7 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
 //    __ompt_event_callback(ompt_event_thread_end);
 //#endif
 
-    __ompc_exit_barrier(&(nest_v_thread_team[0]));
+    __ompc_exit_barrier(&temp_v_thread);
 
 
     /* restore original thread id */
@@ -2202,22 +2701,12 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
 
     __ompc_ompt_set_state(THR_OVHD_STATE, ompt_state_overhead, 0);
 
-
+    /* the workers are done with the team once busy is cleared */
     for (i=1; i<num_threads; i++) {
-      /* hash table isn't really necessary if storing current v_thread in
-       * __omp_current_v_thread.  */
-      //__ompc_remove_from_hash_table(nest_u_thread_team[i].uthread_id);
-      return_value = pthread_detach(nest_u_thread_team[i].uthread_id);
-      Is_True(return_value == 0, ("Could not detach pthread"));
+      __ompc_wait_eq(&nest_workers[i]->busy, 0,
+                     &nest_workers[i]->busy_sleepers);
     }
-
-    __ompc_destroy_task_pool(temp_team.task_pool);
-
-    /* destroy xbarrier info for team */
-    __ompc_xbarrier_info_destroy(&temp_team);
-
-    aligned_free(nest_v_thread_team);
-    aligned_free(nest_u_thread_team);
+    __ompc_nested_pool_put(nest_workers + 1, num_threads - 1);
 
 
     current_u_thread->task = original_v_thread;
@@ -2226,8 +2715,8 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
 
 #ifdef OMPT
     pthread_mutex_lock(&region_counter_mutex);
-    __ompt_parallel_region_id = temp_team.parallel_region_id;
-    __ompt_team_size = temp_team.team_size;
+    __ompt_parallel_region_id = nested_team->parallel_region_id;
+    __ompt_team_size = nested_team->team_size;
 #endif
     __ompc_ompt_event_callback(OMP_EVENT_JOIN, ompt_event_parallel_end);
     __ompc_ompt_set_state(THR_WORK_STATE, ompt_state_work_parallel, 0);
@@ -2235,76 +2724,21 @@ __ompc_fork(const int _num_threads, omp_micro micro_task,
     pthread_mutex_unlock(&region_counter_mutex);
 #endif
 
-    __omp_exe_mode = OMP_EXE_MODE_NORMAL;
+    __ompc_nested_team_put(nested_team);
 
-  } else { /* OMP_EXE_MODE_IN_PARALLEL and nested disabled*/
-    current_u_thread = __ompc_get_current_u_thread();
-    original_v_thread = current_u_thread->task;
-    original_task = __omp_current_task;
-
-    temp_team.team_size = 1;
-    temp_team.team_level = original_v_thread->team->team_level + 1;
-    temp_team.is_nested = 1;
-    temp_team.log2_team_size = 1;
+    __omp_exe_mode = orig_exe_mode;
 
-    //bug 361, get_local_thread_num() return garbage value, Liao
-    temp_v_thread.vthread_id = 0; 
-    temp_v_thread.team_size = 1;
-    temp_v_thread.vthread_id = 0;
-    temp_v_thread.single_count = 0;
-    temp_v_thread.loop_count = 0;
-    temp_v_thread.executor = current_u_thread;
-    temp_v_thread.team = &temp_team;
-    temp_v_thread.entry_func = micro_task;
-    temp_v_thread.frame_pointer = frame_pointer;
-    temp_v_thread.implicit_task = NULL;
-    temp_v_thread.num_suspended_tied_tasks = 0;
-
-    __ompc_init_xbarrier_local_info(&temp_v_thread.xbarrier_local,
-                                   0, &temp_team);
-
-    /* The lock can be eliminated, anyway */
-    /* no need to use lock in this case*/
-    temp_team.loop_count = 0;
-    temp_team.loop_info_size = 0;
-    temp_team.loop_info = NULL;
-    temp_team.single_count = 0;
-
-    temp_team.task_pool = NULL;
-
-    /* FIX THIS */
-    //__ompc_task_pool_set_team_size( __omp_level_1_team_manager.task_pool, 1);
-
-    __ompc_init_spinlock(&(temp_team.schedule_lock));
-    __ompc_init_lock(&(temp_team.single_lock));
-
-    current_u_thread->task = &temp_v_thread;
-    __omp_current_v_thread = &temp_v_thread;
-    __omp_current_task = NULL;
+  } else {
+    /* OMP_EXE_MODE_IN_PARALLEL, nested disabled or a team of one */
+    __ompc_serialized_parallel(__omp_myid);
+    __omp_current_v_thread->entry_func = micro_task;
+    __omp_current_v_thread->frame_pointer = frame_pointer;
 
-    /* Do we really need to maintain such a global status */
-    /* a lock should be added here */
-    __omp_exe_mode = OMP_EXE_MODE_NESTED_SEQUENTIAL;
-    /* execute the task */
-//    __ompc_set_state(THR_WORK_STATE);
-//    __ompc_set_state(THR_WORK_STATE);
     __ompc_ompt_set_state(THR_WORK_STATE, ompt_state_work_parallel, 0);
 
     micro_task(0, frame_pointer);
 
-    /* lock should be added here */
-    /* The exe_mode switch is abandoned for this case.*/
-    /*
-      __omp_nested_team_count--;
-      if (__omp_nested_team_count == 0)
-      __omp_exe_mode = OMP_EXE_MODE_NORMAL;
-    */
-
-    __ompc_destroy_spinlock(&(temp_team.schedule_lock));
-    __ompc_destroy_lock(&(temp_team.single_lock));
-    current_u_thread->task = original_v_thread;
-    __omp_current_v_thread = original_v_thread;
-    __omp_current_task = original_task;
+    __ompc_end_serialized_parallel(__omp_myid);
   }
 
 }
@@ -2329,31 +2763,333 @@ __ompc_check_num_threads(const int _num_threads)
       num_threads = __omp_level_1_team_alloc_size + __omp_max_num_threads;
     }
   } else {/* Request for nest team*/
-    if ((num_threads - 1) > __omp_max_num_threads) {
-      /* Exceed current limit*/
-      /* The master is already there, need not to be allocated*/
-      num_threads = __omp_max_num_threads + 1; 
-      Warning(" Exceed the thread number limit: Reduce to Max");
-    } else {
-      /* OK. we can fulfill your request*/
-    }
+    /* The workers are counted when __ompc_fork reserves them from the
+     * nested pool, under the pool lock: parked ones are reused, not
+     * created, and the team is cut down to what it got. */
   }
   return num_threads;
 }
 
+/* Number of runnable threads in the system that are not ours to give
+ * away: the running count of /proc/loadavg, less the caller and the
+ * level-1 workers that are idle but not parked yet, which would run the
+ * new team. Busy workers of an enclosing team stay in the count. Returns
+ * -1 when the load cannot be read.
+ */
+static int
+__ompc_dynamic_sample_load(void)
+{
+  char buf[128];
+  char *p;
+  int fd, len, running, i, first_idle;
+
+  fd = open("/proc/loadavg", O_RDONLY);
+  if (fd < 0)
+    return -1;
+  len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0)
+    return -1;
+  buf[len] = '\0';
+
+  /* "0.52 0.58 0.59 running/total last_pid" */
+  p = strchr(buf, '/');
+  if (p == NULL)
+    return -1;
+  while (p > buf && isdigit(p[-1]))
+    p--;
+  running = atoi(p) - 1;
+
+  first_idle = (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL) ?
+               1 : __omp_level_1_team_size;
+  for (i = first_idle; i < __omp_level_1_team_alloc_size; i++)
+    if (!__omp_level_1_team[i].fork_flag->sleeping)
+      running--;
+
+  return running > 0 ? running : 0;
+}
+
+/* OMP_DYNAMIC: shrink a team of _num_threads so that, together with
+ * the other runnable threads of the system, it does not oversubscribe
+ * the processors we may use. The load is sampled at most once per
+ * DYNAMIC_SAMPLE_INTERVAL; racing updates of the sample are harmless.
+ */
+int
+__ompc_dynamic_num_threads(const int _num_threads)
+{
+  static volatile int other_load = 0;
+  static volatile long int last_sample = 0;
+  struct timespec now;
+  long int now_ns;
+  int load, available;
+
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  now_ns = now.tv_sec * 1000000000L + now.tv_nsec;
+  if (last_sample == 0 || now_ns - last_sample >= DYNAMIC_SAMPLE_INTERVAL) {
+    last_sample = now_ns;
+    load = __ompc_dynamic_sample_load();
+    if (load < 0)
+      return _num_threads;
+    other_load = load;
+  }
+
+  available = __omp_num_processors - other_load;
+  if (available < 1)
+    available = 1;
+  return _num_threads < available ? _num_threads : available;
+}
+
+/* Switch the level-1 team to another xbarrier algorithm. Called by the
+ * master between regions.
+ */
+static void
+__ompc_level_1_set_xbarrier(omp_xbarrier_t type)
+{
+  int i;
+
+  if (type == __omp_xbarrier_type)
+    return;
+
+  __ompc_level_1_wait_joined();
+  __ompc_xbarrier_info_destroy((omp_team_t *) &__omp_level_1_team_manager);
+
+  __omp_xbarrier_type = type;
+  __ompc_set_xbarrier_wait();
+
+  __ompc_xbarrier_info_create((omp_team_t *) &__omp_level_1_team_manager);
+  for (i = 0; i < __omp_level_1_team_size; i++) {
+    __ompc_init_xbarrier_local_info(&__omp_level_1_team[i].xbarrier_local, i,
+                                    (omp_team_t *) &__omp_level_1_team_manager);
+  }
+}
+
+static long int __omp_xbarrier_calibrate_time;
+static long int __omp_xbarrier_calibrate_count;
+/* set by the master before barrier i in slot i & 1, read by everyone
+ * after it: the slot is not written again before everyone got through
+ * barrier i + 1 */
+static volatile int __omp_xbarrier_calibrate_stop[2];
+
+static void
+__ompc_xbarrier_calibrate_micro(int vthread_id, frame_pointer_t frame_pointer)
+{
+  struct timespec start, now;
+  long int elapsed = 0;
+  int i;
+
+  for (i = 0; i < XBARRIER_CALIBRATE_WARMUP; i++)
+    __ompc_xbarrier_wait((omp_team_t *) &__omp_level_1_team_manager);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; ; i++) {
+    if (vthread_id == 0) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      elapsed = (now.tv_sec - start.tv_sec) * 1000000000L +
+                (now.tv_nsec - start.tv_nsec);
+      __omp_xbarrier_calibrate_stop[i & 1] =
+        i == XBARRIER_CALIBRATE_COUNT || elapsed >= XBARRIER_CALIBRATE_TIME;
+    }
+    __ompc_xbarrier_wait((omp_team_t *) &__omp_level_1_team_manager);
+    if (__omp_xbarrier_calibrate_stop[i & 1])
+      break;
+  }
+
+  if (vthread_id == 0) {
+    __omp_xbarrier_calibrate_time = elapsed;
+    __omp_xbarrier_calibrate_count = i;
+  }
+}
+
+/* O64_OMP_XBARRIER_TYPE=auto: before the first level-1 fork with a
+ * team of num_threads, time every xbarrier algorithm at that size in
+ * a region of its own and keep the fastest. The choice is remembered
+ * for each team size, so a resize only costs a calibration once.
+ */
+void
+__ompc_xbarrier_calibrate(int num_threads)
+{
+  static omp_xbarrier_t *picked = NULL;   /* by team size, -1: unknown */
+  static int picked_size = 0;
+  static const omp_xbarrier_t types[] = {
+    LINEAR_XBARRIER, SIMPLE_XBARRIER, TOUR_XBARRIER,
+    TREE_XBARRIER, DISSEM_XBARRIER, HIER_XBARRIER
+  };
+  omp_xbarrier_t best;
+  long int best_time = -1, time;
+  int dynamic, i;
+
+  if (num_threads <= 1)
+    return;
+
+  if (num_threads >= picked_size) {
+    int new_size = picked_size == 0 ? 16 : picked_size;
+    while (new_size <= num_threads)
+      new_size *= 2;
+    picked = (omp_xbarrier_t *) realloc(picked,
+                                        sizeof(omp_xbarrier_t) * new_size);
+    Is_True(picked != NULL, ("Can't allocate xbarrier calibration table"));
+    for (i = picked_size; i < new_size; i++)
+      picked[i] = (omp_xbarrier_t) -1;
+    picked_size = new_size;
+  }
+
+  if (picked[num_threads] != (omp_xbarrier_t) -1) {
+    __ompc_level_1_set_xbarrier(picked[num_threads]);
+    return;
+  }
+
+  /* the regions below must run at this very size, and are not the
+   * user's: keep them from the tools */
+  __omp_xbarrier_auto = 0;
+  dynamic = __omp_dynamic;
+  __omp_dynamic = 0;
+  __omp_internal_region = 1;
+
+  best = __omp_xbarrier_type;
+  for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    __ompc_level_1_set_xbarrier(types[i]);
+    __ompc_fork(num_threads, __ompc_xbarrier_calibrate_micro, NULL);
+    /* per barrier, the last one is not timed */
+    time = __omp_xbarrier_calibrate_time /
+           (__omp_xbarrier_calibrate_count > 0 ?
+            __omp_xbarrier_calibrate_count : 1);
+    if (best_time < 0 || time < best_time) {
+      best_time = time;
+      best = types[i];
+    }
+  }
+
+  /* the slaves still report the end of the last region */
+  __ompc_level_1_wait_joined();
+  __omp_internal_region = 0;
+  __omp_dynamic = dynamic;
+  __omp_xbarrier_auto = 1;
+
+  picked[num_threads] = best;
+  __ompc_level_1_set_xbarrier(best);
+
+  if (__omp_verbose == 1) {
+    __ompc_print_env_tag("O64_OMP_XBARRIER_TYPE");
+    fprintf(stderr, "__omp_xbarrier_type = %s, picked for %d threads "
+            "(%ld ns per barrier)\n", __ompc_xbarrier_name(best),
+            num_threads, best_time);
+  }
+}
+
 /* How about Critical/Atomic? */
 
 /* TODO: handle critical/atomic affairs here*/
 
+/* One level of serialized parallel regions of a thread: a team of one
+ * that is set up on the first use and then reused, so that running a
+ * region serially costs no allocation, no task pool and no xbarrier
+ * info. The levels of a thread are linked in nesting order.
+ */
+typedef struct omp_serial_team omp_serial_team_t;
+struct omp_serial_team {
+  omp_team_t team;
+  omp_v_thread_t vthread;
+
+  /* state of the enclosing region, restored at the end */
+  omp_v_thread_t *saved_v_thread;
+  omp_task_t *saved_task;
+  omp_exe_mode_t saved_exe_mode;
+
+  omp_serial_team_t *outer;
+  omp_serial_team_t *inner;
+} __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+
+/* the outermost level of the thread, and the one being executed */
+static __thread omp_serial_team_t *__omp_serial_team_first = NULL;
+static __thread omp_serial_team_t *__omp_serial_team = NULL;
+
+static omp_serial_team_t *
+__ompc_serial_team_new(omp_serial_team_t *outer)
+{
+  omp_serial_team_t *serial;
+
+  serial = aligned_malloc(sizeof(omp_serial_team_t), CACHE_LINE_SIZE);
+  Is_True(serial != NULL, ("Cannot allocate serialized team"));
+  memset(serial, 0, sizeof(omp_serial_team_t));
+
+  serial->team.team_size = 1;
+  serial->team.is_nested = 1;
+  serial->team.log2_team_size = 0;
+  serial->team.task_pool = NULL;
+  __ompc_init_spinlock(&(serial->team.schedule_lock));
+
+  serial->vthread.vthread_id = 0;
+  serial->vthread.team_size = 1;
+  serial->vthread.team = &serial->team;
+
+  serial->outer = outer;
+  if (outer != NULL)
+    outer->inner = serial;
+  else
+    __omp_serial_team_first = serial;
+
+  return serial;
+}
+
+/* Start a region that is executed by the calling thread alone, for
+ * if(0) regions and nested regions that get a single thread. In the
+ * sequential part there is nothing to do: the thread already behaves
+ * as a team of one.
+ */
 void
 __ompc_serialized_parallel (int vthread_id)
 {
+  omp_serial_team_t *serial;
+  omp_v_thread_t *original_v_thread;
 
+  __ompc_fuzzy_barrier_resolve();
+  if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
+    return;
+
+  serial = __omp_serial_team != NULL ?
+           __omp_serial_team->inner : __omp_serial_team_first;
+  if (serial == NULL)
+    serial = __ompc_serial_team_new(__omp_serial_team);
+
+  original_v_thread = __ompc_get_current_v_thread();
+  serial->saved_v_thread = original_v_thread;
+  serial->saved_task = __omp_current_task;
+  serial->saved_exe_mode = __omp_exe_mode;
+
+  serial->team.team_level = original_v_thread->team->team_level + 1;
+  serial->team.single_count = 0;
+  serial->team.loop_count = 0;
+
+  serial->vthread.single_count = 0;
+  serial->vthread.loop_count = 0;
+  serial->vthread.executor = original_v_thread->executor;
+  serial->vthread.entry_func = NULL;
+  serial->vthread.frame_pointer = NULL;
+  serial->vthread.implicit_task = NULL;
+  serial->vthread.num_suspended_tied_tasks = 0;
+
+  serial->vthread.executor->task = &serial->vthread;
+  __omp_current_v_thread = &serial->vthread;
+  /* tasks of the region run right away */
+  __omp_current_task = NULL;
+  __omp_exe_mode = OMP_EXE_MODE_NESTED_SEQUENTIAL;
+  __omp_serial_team = serial;
 }
 
 void
 __ompc_end_serialized_parallel (int vthread_id)
 {
+  omp_serial_team_t *serial = __omp_serial_team;
+
+  if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
+    return;
+
+  Is_True(serial != NULL, ("no serialized parallel region to end"));
 
+  serial->vthread.executor->task = serial->saved_v_thread;
+  __omp_current_v_thread = serial->saved_v_thread;
+  __omp_current_task = serial->saved_task;
+  __omp_exe_mode = serial->saved_exe_mode;
+  __omp_serial_team = serial->outer;
 }
 
@@ -55,13 +55,17 @@
  */
 
 extern pthread_mutex_t __omp_hash_table_lock;
+extern void __ompc_resize_hash_table(int num_threads);
 
 extern int __ompc_init_rtl(int num_threads);
 
 extern int __ompc_check_num_threads(const int _num_threads);
+extern int __ompc_dynamic_num_threads(const int _num_threads);
+extern void __ompc_xbarrier_calibrate(int num_threads);
 extern void __ompc_expand_level_1_team(int new_num_threads);
 
 extern void (*__ompc_xbarrier_wait)(omp_team_t *team);
+extern void (*__ompc_xbarrier_join)(omp_team_t *team);
 
 
 static inline void __ompc_check_rtl_init()
@@ -158,7 +162,8 @@ inline int __ompc_in_parallel(void)
 
 static inline void __ompc_clear_hash_table(void)
 {
-  memset(__omp_uthread_hash_table, 0, sizeof(__omp_uthread_hash_table));
+  memset(__omp_uthread_hash_table, 0,
+         sizeof(omp_u_thread_t *) * __omp_uthread_hash_size);
 }
 
 static inline void __ompc_insert_into_hash_table(omp_u_thread_t * new_u_thread)
@@ -167,7 +172,7 @@ static inline void __ompc_insert_into_hash_table(omp_u_thread_t * new_u_thread)
   int hash_index;
   pthread_t uthread_id = new_u_thread->uthread_id;
 
-  hash_index = HASH_IDX(uthread_id);
+  hash_index = HASH_IDX(uthread_id, __omp_uthread_hash_size);
 	
   pthread_mutex_lock(&__omp_hash_table_lock);
 
@@ -183,7 +188,7 @@ static inline void __ompc_remove_from_hash_table(pthread_t uthread_id)
   omp_u_thread_t *uthread_temp;
   int hash_index;
 
-  hash_index = HASH_IDX(uthread_id);
+  hash_index = HASH_IDX(uthread_id, __omp_uthread_hash_size);
   pthread_mutex_lock(&__omp_hash_table_lock);
 
   uthread_temp = __omp_uthread_hash_table[hash_index];
@@ -225,7 +230,8 @@ inline omp_u_thread_t * __ompc_get_current_u_thread()
 
   current_uthread_id = pthread_self();
 
-  uthread_temp = __omp_uthread_hash_table[HASH_IDX(current_uthread_id)];
+  uthread_temp = __omp_uthread_hash_table[HASH_IDX(current_uthread_id,
+                                               __omp_uthread_hash_size)];
 
   Is_True(uthread_temp != NULL, ("This pThread is not in hash table!"));
 
@@ -314,25 +320,20 @@ inline omp_team_t * __ompc_get_current_team(void)
 }
 
 extern __thread int total_tasks;
-extern long int __omp_spin_count; // defined in omp_thread.c
-extern long int __omp_wait_time;  // defined in omp_thread.c
 extern __thread int total_tasks;
 
 /* Should not be called directly, use __ompc_barrier instead*/
 void __ompc_barrier_wait(omp_team_t *team)
 {
   /*Warning: This implementation may cause cache problems*/
-  long int counter;
+  omp_spin_t spin;
   int *bar_count;
   int barrier_flag;
   int new_count;
-  int i,j,k;
   volatile int *barrier_flag_p;
   omp_task_t *next, *current_task;
   omp_task_pool_t *pool;
 
-  j = 0;
-  k = 0;
   barrier_flag_p = &(team->barrier_flag);
   barrier_flag = *barrier_flag_p;
 
@@ -344,27 +345,17 @@ void __ompc_barrier_wait(omp_team_t *team)
   bar_count = &team->barrier_count;
   new_count = __ompc_atomic_inc(bar_count);
 
-  for (counter = 0; (*bar_count < team->team_size) ||
-          __ompc_task_pool_num_pending_tasks(pool); counter++ ) {
+  __ompc_spin_init(&spin);
+  while ((*bar_count < team->team_size) ||
+          __ompc_task_pool_num_pending_tasks(pool)) {
 
       while (__ompc_task_pool_num_pending_tasks(pool) &&
              (next = __ompc_remove_task_from_pool(pool))) {
           if (next != NULL)
               __ompc_task_switch(next);
       }
-      if (counter > __omp_spin_count) {
-          pthread_mutex_lock(&pool->pool_lock);
-          if (__ompc_task_pool_num_pending_tasks(pool) == 0 &&
-                  *bar_count <  team->team_size) {
-              struct timespec ts;
-              clock_gettime(CLOCK_REALTIME, &ts);
-              ts.tv_nsec += __omp_wait_time;
-              pthread_cond_timedwait(&pool->pool_cond,
-                                &pool->pool_lock,
-                                &ts);
-          }
-          pthread_mutex_unlock(&pool->pool_lock);
-      }
+      if (!__ompc_spin(&spin))
+          __ompc_task_pool_idle_wait(pool, __omp_wait_time);
   }
 
   new_count = __ompc_atomic_inc(&team->barrier_count2);
@@ -375,24 +366,11 @@ void __ompc_barrier_wait(omp_team_t *team)
     team->barrier_count2 = 0;
     team->barrier_flag = barrier_flag ^ 1; /* Xor: toggle*/
 
-    pthread_mutex_lock(&(team->barrier_lock));
-    pthread_cond_broadcast(&(team->barrier_cond));
-    pthread_mutex_unlock(&(team->barrier_lock));
+    __ompc_wake(barrier_flag_p, &team->barrier_sleepers);
 
   } else {
     /* Wait for the last to reset te barrier*/
-    /* We must make sure that every waiting thread get this
-     * signal */
-    for (i = 0; i < __omp_spin_count; i++)
-      if ((*barrier_flag_p) != barrier_flag) {
-        __ompc_task_set_state(current_task, OMP_TASK_RUNNING);
-        return;
-      }
-    pthread_mutex_lock(&(team->barrier_lock));
-    while (team->barrier_flag == barrier_flag) {
-      pthread_cond_wait(&(team->barrier_cond), &(team->barrier_lock));
-    }
-    pthread_mutex_unlock(&(team->barrier_lock));
+    __ompc_wait_ne(barrier_flag_p, barrier_flag, &team->barrier_sleepers);
   }
 
   __ompc_task_set_state(current_task, OMP_TASK_RUNNING);
@@ -401,12 +379,36 @@ void __ompc_barrier_wait(omp_team_t *team)
 
 
 
+/* Fuzzy barrier: the implicit barrier of a worksharing construct that
+ * the next barrier of the team, or the join, can stand in for. The
+ * thread does not wait here; the barrier is left pending and the next
+ * __ompc_barrier, __ompc_ebarrier or end of the region synchronizes the
+ * team once for both. Any other entry point that synchronizes with the
+ * team runs the pending barrier first, see __ompc_fuzzy_barrier_resolve.
+ * The compiler emits it only when the code up to the next runtime call
+ * does not read what other threads wrote in the construct, e.g. for the
+ * 'for' that ends a parallel region.
+ */
+void __ompc_fuzzy_barrier(void)
+{
+  omp_v_thread_t *p_vthread;
+
+  if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
+    return;
+  p_vthread = __ompc_get_v_thread_by_num(__omp_myid);
+  if (p_vthread->team_size == 1)
+    return;
+  p_vthread->fuzzy_barrier = 1;
+}
+
 /* vthread_id is of no use in this implementation*/
 /* exposed to outer world, should be unified*/
 inline void __ompc_barrier(void)
 {
   omp_v_thread_t *temp_v_thread;
   omp_v_thread_t *p_vthread = __ompc_get_v_thread_by_num( __omp_myid);
+  /* a pending fuzzy barrier is folded into this one */
+  p_vthread->fuzzy_barrier = 0;
   p_vthread->thr_ibar_state_id++;
   __ompc_ompt_set_state(THR_IBAR_STATE, ompt_state_wait_barrier_implicit, 0);
   __ompc_ompt_event_callback(OMP_EVENT_THR_BEGIN_IBAR, ompt_event_wait_barrier_begin);
@@ -432,7 +434,7 @@ inline void __ompc_barrier(void)
     return;
   }
   else {
-    __ompc_barrier_wait(temp_v_thread->team);
+    __ompc_xbarrier_wait(temp_v_thread->team);
   }
 __ompc_ompt_event_callback(OMP_EVENT_THR_END_IBAR, ompt_event_wait_barrier_end);
 __ompc_ompt_set_state(THR_WORK_STATE, ompt_state_work_parallel, 0);
@@ -442,6 +444,7 @@ void __ompc_ebarrier(void)
 {
     omp_v_thread_t *temp_v_thread;
    omp_v_thread_t *p_vthread = __ompc_get_v_thread_by_num( __omp_myid);
+    p_vthread->fuzzy_barrier = 0;
     p_vthread->thr_ebar_state_id++;
 	__ompc_ompt_set_state(THR_EBAR_STATE, ompt_state_wait_barrier_explicit, 0);
   __ompc_ompt_event_callback(OMP_EVENT_THR_BEGIN_EBAR, ompt_event_wait_barrier_begin);
@@ -469,17 +472,65 @@ void __ompc_ebarrier(void)
     return;
   }
   else {
-    __ompc_barrier_wait(temp_v_thread->team);
+    __ompc_xbarrier_wait(temp_v_thread->team);
   }
   __ompc_ompt_event_callback(OMP_EVENT_THR_END_IBAR, ompt_event_wait_barrier_end);
   __ompc_ompt_set_state(THR_WORK_STATE, ompt_state_work_parallel, 0);
 }
 
+/* Split-phase barrier: __ompc_barrier_arrive() signals that the thread
+ * reached the barrier and returns the phase, __ompc_barrier_wait_phase()
+ * with that phase returns once every thread of the team has arrived.
+ * The thread may do work of its own in between. Unlike __ompc_barrier,
+ * it does not wait for the tasks of the team.
+ */
+int __ompc_barrier_arrive(void)
+{
+  omp_team_t *team;
+  int phase;
+
+  __ompc_fuzzy_barrier_resolve();
+  if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
+    return 0;
+  team = (__omp_exe_mode & OMP_EXE_MODE_NORMAL) ?
+         (omp_team_t *) &__omp_level_1_team_manager :
+         __ompc_get_current_v_thread()->team;
+  if (team->team_size == 1)
+    return 0;
+
+  /* the phase cannot move on before we have arrived */
+  phase = team->split_phase;
+  if (__ompc_atomic_inc(&team->split_count) == team->team_size) {
+    /* The last one resets the count before it opens the next phase */
+    team->split_count = 0;
+    __ompc_mfence();
+    team->split_phase = phase + 1;
+    __ompc_wake(&team->split_phase, &team->split_sleepers);
+  }
+  return phase;
+}
+
+void __ompc_barrier_wait_phase(int phase)
+{
+  omp_team_t *team;
+
+  if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
+    return;
+  team = (__omp_exe_mode & OMP_EXE_MODE_NORMAL) ?
+         (omp_team_t *) &__omp_level_1_team_manager :
+         __ompc_get_current_v_thread()->team;
+  if (team->team_size == 1)
+    return;
+
+  __ompc_wait_ne(&team->split_phase, phase, &team->split_sleepers);
+  __ompc_mfence();
+}
+
 /* Exposed API should be moved to somewhere else, instead of been inlined*/
 /* flush needs to do nothing on IA64 based platforms?*/
 inline void __ompc_flush(void *p)
 {
-
+  __ompc_fuzzy_barrier_resolve();
 }
 
 /* stuff function. Required by legacy code for Guide*/
@@ -549,23 +600,20 @@ static inline void __omp_get_available_processors()
     free(ordered_core_list);
 }
 
-static int cur_cpu_to_bind;
-
-/* bind the pthread to a specific cpu */
-static inline void __ompc_bind_pthread_to_cpu(pthread_t thread)
+/* bind the pthread to the cpu picked for level-1 thread index.
+ * Threads are spread round robin over the available cpus by index, so
+ * the binding does not depend on the order in which they are created.
+ */
+static inline void __ompc_bind_pthread_to_cpu(pthread_t thread, int index)
 {
   cpu_set_t cpuset;
   int return_val;
   
   CPU_ZERO(&cpuset);
-  CPU_SET(__omp_list_processors[cur_cpu_to_bind],&cpuset);
+  CPU_SET(__omp_list_processors[index % __omp_core_list_size],&cpuset);
 
   return_val = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
   Is_True(return_val == 0, ("Set affinity error"));
-
-  // next cpu to bind
-  cur_cpu_to_bind = (cur_cpu_to_bind + 1) % __omp_core_list_size; 
-
 }
 #endif //TARG_LOONGSON
 
@@ -51,6 +51,15 @@ typedef double    omp_wtime_t;
 typedef void     *omp_lock_t; 
 typedef void     *omp_nest_lock_t; 
 
+/* hints of omp_init_lock_with_hint, as in OpenMP 4.5 */
+typedef enum omp_lock_hint_t {
+  omp_lock_hint_none = 0,
+  omp_lock_hint_uncontended = 1,
+  omp_lock_hint_contended = 2,
+  omp_lock_hint_nonspeculative = 4,
+  omp_lock_hint_speculative = 8
+} omp_lock_hint_t;
+
 #define TRUE	1
 #define FALSE	0
 
@@ -40,6 +40,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
+#include <alloca.h>
 #include <ctype.h>
 #include <unistd.h>
 #include "omp_util.h"
@@ -117,6 +119,70 @@ Get_CPU_Cores(void)
   return 0;
 }
 
+/*
+ * Read the first cpu of a cpu list file of sysfs, such as
+ * "/sys/devices/system/cpu/cpu3/topology/thread_siblings_list"
+ * holding "2-3". Returns -1 when the file cannot be read.
+ */
+static int
+get_first_cpu_of_list(const char *format, int cpu)
+{
+  FILE * fp;
+  char path[256], buf[256];
+  int first = -1;
+
+  snprintf(path, sizeof(path), format, cpu);
+  if ((fp = fopen (path, "r")) == NULL)
+    return -1;
+  if (fgets (buf, 256, fp) != NULL && isdigit((int)buf[0]))
+    first = atoi(buf);
+  fclose(fp);
+  return first;
+}
+
+/*
+ * Get the cache and socket topology of cpus 0 .. total_cores-1 from
+ * sysfs. For every cpu, the lowest cpu that shares its core (SMT
+ * siblings), its last level cache (L3) and its socket is stored to
+ * core[], llc[] and socket[] respectively, so that two cpus share a
+ * level iff they have the same entry.
+ *
+ * Missing information is filled in conservatively: a cpu is a core of
+ * its own, the last level cache is the socket, and all cpus are on
+ * the same socket.
+ */
+void
+Get_CPU_Topology(int *core, int *llc, int *socket, int total_cores)
+{
+  int i;
+
+  for (i = 0; i < total_cores; i++) {
+    socket[i] = get_first_cpu_of_list(
+      "/sys/devices/system/cpu/cpu%d/topology/core_siblings_list", i);
+    if (socket[i] < 0 || socket[i] >= total_cores)
+      socket[i] = 0;
+
+    llc[i] = get_first_cpu_of_list(
+      "/sys/devices/system/cpu/cpu%d/cache/index3/shared_cpu_list", i);
+    if (llc[i] < 0 || llc[i] >= total_cores)
+      llc[i] = socket[i];
+
+    core[i] = get_first_cpu_of_list(
+      "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", i);
+    if (core[i] < 0 || core[i] >= total_cores)
+      core[i] = i;
+  }
+
+  if (__omp_verbose == 1) {
+    fprintf(stderr, "Get_CPU_Topology: cpu:core/llc/socket ");
+    for (i = 0; i < total_cores; i++) {
+      fprintf(stderr, "%s%d:%d/%d/%d", i > 0 ? "," : "", i,
+              core[i], llc[i], socket[i]);
+    }
+    fprintf(stderr, "\n");
+  }
+}
+
 /*
  * Check if the user specifies an environment variable to map
  * the core to thread.
@@ -479,6 +545,55 @@ void* aligned_realloc(void *p, size_t old_size, size_t new_size, size_t alignmen
           
 }
 
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+/*
+ * Reserve a thread stack of "bytes" with mmap(). The pages are neither
+ * committed against swap (MAP_NORESERVE) nor touched, so a page only
+ * gets backed when the thread faults it in, from the NUMA node it runs
+ * on. The lowest "guard" bytes are made inaccessible to catch stack
+ * overflows. Both sizes must be multiples of the page size.
+ *
+ * It returns the lowest usable address, as pthread_attr_setstack()
+ * wants it, or NULL on failure.
+ */
+
+void* stack_alloc(size_t bytes, size_t guard)
+{
+  char *p;
+
+  p = mmap(NULL, bytes + guard, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+
+  if (guard != 0 && mprotect(p, guard, PROT_NONE) != 0) {
+    munmap(p, bytes + guard);
+    return NULL;
+  }
+
+  return (void*) (p + guard);
+}
+
+/*
+ * Fault in "bytes" of the calling thread's stack below the caller's
+ * frame, one write per page. Called by a thread once it is bound, so
+ * that the part of its stack it always uses is local to it.
+ */
+
+void __attribute__ ((noinline)) stack_prefault(size_t bytes)
+{
+  volatile char *window;
+  size_t page = getpagesize();
+  size_t i;
+
+  window = alloca(bytes);
+  for (i = 0; i < bytes; i += page)
+    window[i] = 0;
+}
+
 void
 __ompc_do_nothing (void)
 {
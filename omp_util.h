@@ -85,26 +85,12 @@ Not_Valid (char * error_message) __attribute__ ((__noreturn__));
 void
 Warning (char * warning_message);
 
-/* Waiting while condition is true */
-//#define MAX_COUNT 50000
-#define MAX_COUNT 1000000000
-#define OMPC_WAIT_WHILE(condition) \
-      { \
-          if (condition) { \
-              int count = 0; \
-              while (condition) { \
-                   if (count > MAX_COUNT) { \
-	                count = 0; \
-                   } \
-		   count++; \
-              } \
-          } \
-      }
+/* OMPC_WAIT_WHILE is in omp_wait.h */
 
 /* Hash stuff*/
-#define UTHREAD_HASH_SIZE  0x100L
-#define UTHREAD_HASH_MASK (UTHREAD_HASH_SIZE-1)
-#define HASH_IDX(ID) ((int)((unsigned long int)(ID) & (UTHREAD_HASH_MASK)))
+/* minimal number of buckets, the table grows (power of 2) with the team */
+#define UTHREAD_HASH_SIZE_MIN  0x100L
+#define HASH_IDX(ID, SIZE) ((int)((unsigned long int)(ID) & ((SIZE) - 1)))
 
 /* string stuff*/
 char *
@@ -120,6 +106,9 @@ Get_SMP_CPU_num(void);
 int
 Get_CPU_Cores(void);
 
+void
+Get_CPU_Topology(int *, int *, int *, int);
+
 int 
 Get_Affinity_Map(int**, int);
 
@@ -135,5 +124,11 @@ aligned_free(void*);
 void *
 aligned_realloc(void *, size_t, size_t, size_t);
 
+void *
+stack_alloc(size_t, size_t);
+
+void
+stack_prefault(size_t);
+
 void __ompc_do_nothing(void);
 #endif
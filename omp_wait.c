@@ -0,0 +1,140 @@
+/*
+ Wait engine for OpenUH's OpenMP runtime library
+
+ Copyright (C) 2014 University of Houston.
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of version 2 of the GNU General Public License as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it would be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+ Further, this software is distributed without any warranty that it is
+ free of the rightful claim of any third person regarding infringement
+ or the like.  Any license provided herein, whether implied or
+ otherwise, applies only to this software file.  Patent licenses, if
+ any, provided herein do not apply to combinations of this program with
+ other software, or any other product whatsoever.
+
+ You should have received a copy of the GNU General Public License along
+ with this program; if not, write the Free Software Foundation, Inc., 59
+ Temple Place - Suite 330, Boston MA 02111-1307, USA.
+
+ Contact information:
+ http://www.cs.uh.edu/~hpctools
+*/
+
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "omp_rtl.h"
+#include "omp_wait.h"
+
+/* number of relax hints timed to calibrate the spin budget */
+#define SPIN_CALIBRATE_COUNT 10000
+
+/* Sleep while *addr == val, for at most ns nanoseconds (0: no limit) */
+int
+__ompc_futex_wait(volatile int *addr, int val, long int ns)
+{
+  struct timespec ts;
+
+  if (ns == 0)
+    return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+
+  ts.tv_sec = ns / 1000000000L;
+  ts.tv_nsec = ns % 1000000000L;
+  return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+int
+__ompc_futex_wake(volatile int *addr, int nwake)
+{
+  return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nwake, NULL, NULL, 0);
+}
+
+/* Turn the wait policy and the spin time into __omp_spin_count.
+ * Called once the environment variables are parsed.
+ */
+void
+__ompc_wait_init(void)
+{
+  struct timespec start, end;
+  long int elapsed;
+  int i;
+
+  if (__omp_wait_policy == OMP_WAIT_POLICY_ACTIVE) {
+    __omp_spin_count = LONG_MAX;
+    return;
+  }
+  if (__omp_wait_policy == OMP_WAIT_POLICY_PASSIVE) {
+    __omp_spin_count = 0;
+    return;
+  }
+  /* set by O64_OMP_SPIN_COUNT */
+  if (__omp_spin_count > 0)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < SPIN_CALIBRATE_COUNT; i++)
+    __ompc_cpu_relax();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  elapsed = (end.tv_sec - start.tv_sec) * 1000000000L +
+            (end.tv_nsec - start.tv_nsec);
+  if (elapsed <= 0)
+    elapsed = 1;
+
+  __omp_spin_count = (long int)((double) __omp_spin_time *
+                                SPIN_CALIBRATE_COUNT / elapsed);
+  if (__omp_spin_count < 1)
+    __omp_spin_count = 1;
+}
+
+/* Common part of __ompc_wait_ne/eq. The sleeper is counted before
+ * *addr is checked for the last time, and the waker changes *addr
+ * before it looks at *sleepers, so one of the two always sees the
+ * other.
+ */
+static void
+__ompc_wait_until(volatile int *addr, int val, int equal,
+                  volatile int *sleepers)
+{
+  omp_spin_t spin;
+  int cur;
+
+  __ompc_spin_init(&spin);
+  while ((*addr == val) != equal) {
+    if (!__ompc_spin(&spin)) {
+      __ompc_atomic_inc(sleepers);
+      while (((cur = *addr) == val) != equal)
+        __ompc_futex_wait(addr, cur, 0);
+      __ompc_atomic_dec(sleepers);
+      return;
+    }
+  }
+}
+
+void
+__ompc_wait_ne(volatile int *addr, int val, volatile int *sleepers)
+{
+  __ompc_wait_until(addr, val, 0, sleepers);
+}
+
+void
+__ompc_wait_eq(volatile int *addr, int val, volatile int *sleepers)
+{
+  __ompc_wait_until(addr, val, 1, sleepers);
+}
+
+void
+__ompc_wake(volatile int *addr, volatile int *sleepers)
+{
+  __ompc_mfence();
+  if (*sleepers)
+    __ompc_futex_wake(addr, INT_MAX);
+}
@@ -0,0 +1,128 @@
+/*
+ Wait engine for OpenUH's OpenMP runtime library
+
+ Copyright (C) 2014 University of Houston.
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of version 2 of the GNU General Public License as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it would be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+ Further, this software is distributed without any warranty that it is
+ free of the rightful claim of any third person regarding infringement
+ or the like.  Any license provided herein, whether implied or
+ otherwise, applies only to this software file.  Patent licenses, if
+ any, provided herein do not apply to combinations of this program with
+ other software, or any other product whatsoever.
+
+ You should have received a copy of the GNU General Public License along
+ with this program; if not, write the Free Software Foundation, Inc., 59
+ Temple Place - Suite 330, Boston MA 02111-1307, USA.
+
+ Contact information:
+ http://www.cs.uh.edu/~hpctools
+*/
+
+/*
+ * File: omp_wait.h
+ * Abstract: common spin/park routines used by every wait of the RTL.
+ *
+ * A wait first spins with exponential backoff, issuing a CPU relax
+ * hint between polls. Once the spin budget (__omp_spin_count, counted
+ * in relax hints) is used up, the thread parks: on a futex for flags
+ * that a waker signals through __ompc_wake(), for a bounded time in
+ * the idle registry of the task pool for waits that also look for
+ * tasks, or by yielding the CPU when nobody signals the condition.
+ *
+ * OMP_WAIT_POLICY=active never parks, OMP_WAIT_POLICY=passive parks
+ * right away. Otherwise the budget is O64_OMP_SPIN_TIME nanoseconds,
+ * calibrated at start up, unless O64_OMP_SPIN_COUNT gives it directly.
+ */
+#ifndef __omp_wait_included
+#define __omp_wait_included
+
+#include <pthread.h>
+#include <sched.h>
+#include "omp_sys.h"
+
+typedef enum {
+  OMP_WAIT_POLICY_DEFAULT = 0,	/* spin for the budget, then park */
+  OMP_WAIT_POLICY_ACTIVE,	/* spin only */
+  OMP_WAIT_POLICY_PASSIVE	/* park right away */
+} omp_wait_policy_t;
+
+/* upper bound of one backoff step, in relax hints */
+#define OMP_SPIN_BACKOFF_MAX	64
+
+extern omp_wait_policy_t __omp_wait_policy;
+extern long int __omp_spin_time;	/* spin budget, in ns */
+extern long int __omp_spin_count;	/* spin budget, in relax hints */
+extern long int __omp_wait_time;	/* bound of a timed park, in ns */
+
+typedef struct {
+  long int spins;		/* relax hints issued so far */
+  int backoff;			/* length of the next backoff step */
+} omp_spin_t;
+
+static inline void
+__ompc_spin_init(omp_spin_t *spin)
+{
+  spin->spins = 0;
+  spin->backoff = 1;
+}
+
+/* One backoff step. Returns 0, without spinning, once the spin budget
+ * is used up and the caller should park.
+ */
+static inline int
+__ompc_spin(omp_spin_t *spin)
+{
+  int i;
+
+  if (spin->spins >= __omp_spin_count)
+    return 0;
+  for (i = 0; i < spin->backoff; i++)
+    __ompc_cpu_relax();
+  spin->spins += spin->backoff;
+  if (spin->backoff < OMP_SPIN_BACKOFF_MAX)
+    spin->backoff <<= 1;
+  return 1;
+}
+
+/* For waits nobody signals: spin, then give the CPU away */
+static inline void
+__ompc_spin_or_yield(omp_spin_t *spin)
+{
+  if (!__ompc_spin(spin))
+    sched_yield();
+}
+
+/* Waiting while condition is true */
+#define OMPC_WAIT_WHILE(condition) \
+      { \
+          if (condition) { \
+              omp_spin_t __spin; \
+              __ompc_spin_init(&__spin); \
+              while (condition) { \
+                  __ompc_spin_or_yield(&__spin); \
+              } \
+          } \
+      }
+
+extern void __ompc_wait_init(void);
+
+/* Wait until *addr != val (resp. == val). A parked waiter is counted in
+ * *sleepers, whoever changes *addr must call __ompc_wake() afterwards.
+ */
+extern void __ompc_wait_ne(volatile int *addr, int val, volatile int *sleepers);
+extern void __ompc_wait_eq(volatile int *addr, int val, volatile int *sleepers);
+extern void __ompc_wake(volatile int *addr, volatile int *sleepers);
+
+/* Sleep while *addr == val, for at most ns nanoseconds (0: no limit) */
+extern int __ompc_futex_wait(volatile int *addr, int val, long int ns);
+extern int __ompc_futex_wake(volatile int *addr, int nwake);
+
+#endif /* __omp_wait_included */
@@ -34,7 +34,15 @@
 
 
 omp_xbarrier_t __omp_xbarrier_type;
+int __omp_xbarrier_arrival_radix = 0;
+int __omp_xbarrier_wakeup_radix = 0;
 void (*__ompc_xbarrier_wait)(omp_team_t *team);
+/* the barrier algorithm __ompc_xbarrier_task_wait runs */
+static void (*__ompc_xbarrier_algorithm)(omp_team_t *team);
+/* arrival-only half of the barrier used for the end of a level-1
+ * region, NULL when the join is done by __ompc_level_1_barrier itself */
+void (*__ompc_xbarrier_join)(omp_team_t *team);
+
 
 extern void __ompc_barrier_wait(omp_team_t *team);
 
@@ -44,31 +52,250 @@ void __ompc_xbarrier_binary_wait(omp_team_t *team);
 void __ompc_xbarrier_dissem_wait(omp_team_t *team);
 void __ompc_xbarrier_tour_wait(omp_team_t *team);
 void __ompc_xbarrier_tree_wait(omp_team_t *team);
+void __ompc_xbarrier_hier_wait(omp_team_t *team);
+
+void __ompc_xbarrier_simple_join(omp_team_t *team);
+void __ompc_xbarrier_tour_join(omp_team_t *team);
+void __ompc_xbarrier_tree_join(omp_team_t *team);
+void __ompc_xbarrier_hier_join(omp_team_t *team);
+
+void __ompc_xbarrier_task_wait(omp_team_t *team);
 
 void tour_xbarrier_init(int vpid, omp_round_t **myrounds, omp_team_t *team);
 void tree_xbarrier_init(int vpid, omp_treenode_t **mynode, omp_team_t *team);
+void hier_xbarrier_init(int vpid, omp_hiernode_t **mynode, omp_team_t *team);
+
+/* One step of waiting in a barrier: run a task of the team if there is
+ * one, otherwise back off. Returns 1 once the spin budget is used up and
+ * the caller should park in the idle registry of the task pool.
+ */
+static inline int __ompc_xbarrier_idle(omp_team_t *team, omp_spin_t *spin)
+{
+  omp_task_pool_t *pool = team->task_pool;
+  omp_task_t *next;
+
+  if (pool == NULL) {
+    __ompc_spin_or_yield(spin);
+    return 0;
+  }
+
+  if (__ompc_task_pool_num_pending_tasks(pool) &&
+      (next = __ompc_remove_task_from_pool(pool)) != NULL) {
+    __ompc_task_switch(next);
+    return 0;
+  }
+
+  return !__ompc_spin(spin);
+}
+
+/* Wake thread id if it is parked in XBARRIER_WAIT_WHILE, after setting
+ * the flag it waits on */
+static inline void __ompc_xbarrier_wake(omp_team_t *team, int id)
+{
+  if (team->task_pool != NULL)
+    __ompc_task_pool_wake_idle_thread(team->task_pool, id);
+}
+
+/* Likewise, for a flag the whole team waits on */
+static inline void __ompc_xbarrier_wake_all(omp_team_t *team)
+{
+  if (team->task_pool != NULL)
+    __ompc_task_pool_wake_all_idle(team->task_pool);
+}
+
+/* Waiting while condition is true, running tasks of the team meanwhile.
+ * A parked waiter is woken by __ompc_xbarrier_wake(_all), or by a new task;
+ * the condition is checked again once its slot is published, so the
+ * wake cannot be missed. The park is still bounded by __omp_wait_time,
+ * for a task queued just before the slot was.
+ */
+#define XBARRIER_WAIT_WHILE(team, condition) \
+      { \
+          if (condition) { \
+              omp_spin_t __spin; \
+              __ompc_spin_init(&__spin); \
+              while (condition) { \
+                  if (__ompc_xbarrier_idle(team, &__spin)) { \
+                      __ompc_task_pool_idle_enter(team->task_pool); \
+                      if (condition) \
+                          __ompc_task_pool_idle_sleep(team->task_pool, \
+                                                      __omp_wait_time); \
+                      __ompc_task_pool_idle_leave(team->task_pool); \
+                  } \
+              } \
+          } \
+      }
+
+/* Levels of the hierarchical barrier below the whole machine: threads
+ * sharing a core, then a last level cache, then a socket. For each
+ * level, hier_keys[level][i % hier_num_keys] is the same for two
+ * threads i iff the cpus they are bound to share that level (see
+ * __ompc_bind_pthread_to_cpu and Get_CPU_Topology).
+ */
+#define HIER_LEVELS 3
+static int *hier_keys[HIER_LEVELS];
+static int hier_num_keys = 0;
+
+static void hier_xbarrier_topology(void)
+{
+  int *topology[HIER_LEVELS];
+  int nprocs = __omp_num_hardware_processors;
+  int i, cpu, level;
+
+  if (hier_num_keys != 0)
+    return;
+
+  for (level = 0; level < HIER_LEVELS; level++) {
+    topology[level] = (int *) malloc(sizeof(int) * nprocs);
+    Is_True(topology[level] != NULL, ("Can't allocate cpu topology"));
+  }
+  Get_CPU_Topology(topology[0], topology[1], topology[2], nprocs);
+
+  hier_num_keys = __omp_list_processors != NULL ? __omp_core_list_size : nprocs;
+  for (level = 0; level < HIER_LEVELS; level++) {
+    hier_keys[level] = (int *) malloc(sizeof(int) * hier_num_keys);
+    Is_True(hier_keys[level] != NULL, ("Can't allocate cpu topology"));
+    for (i = 0; i < hier_num_keys; i++) {
+      cpu = __omp_list_processors != NULL ? __omp_list_processors[i] : i;
+      hier_keys[level][i] = topology[level][cpu];
+    }
+    free(topology[level]);
+  }
+}
+
+/* Build the combining tree of a team. At each level, the lowest thread
+ * of every group is its representative and the parent of the rest of
+ * the group; only the representatives go on to the next level. Thread
+ * 0 thus ends up as the root, and a single thread per socket reaches
+ * across sockets. A node lists the children of its outer levels first,
+ * so that the release crosses the slowest links first.
+ */
+static void hier_xbarrier_build(omp_hiernode_t *nodes, int team_size)
+{
+  int *leader, *active;
+  int num_active, num_kept;
+  int i, id, key, level;
+
+  leader = (int *) malloc(sizeof(int) * __omp_num_hardware_processors);
+  active = (int *) malloc(sizeof(int) * team_size);
+  Is_True(leader != NULL && active != NULL,
+          ("Can't allocate hierarchical barrier tree"));
+
+  memset(nodes, 0, sizeof(omp_hiernode_t) * team_size);
+  for (i = 0; i < team_size; i++) {
+    nodes[i].parent = -1;
+    nodes[i].first_child = -1;
+    nodes[i].next_sibling = -1;
+    active[i] = i;
+  }
+  num_active = team_size;
+
+  /* the last level is the whole machine, all in one group */
+  for (level = 0; level <= HIER_LEVELS; level++) {
+    for (i = 0; i < __omp_num_hardware_processors; i++)
+      leader[i] = -1;
+
+    num_kept = 0;
+    for (i = 0; i < num_active; i++) {
+      id = active[i];
+      key = level < HIER_LEVELS ? hier_keys[level][id % hier_num_keys] : 0;
+      if (leader[key] < 0) {
+        leader[key] = id;
+        active[num_kept++] = id;
+      } else {
+        nodes[id].parent = leader[key];
+        nodes[id].next_sibling = nodes[leader[key]].first_child;
+        nodes[leader[key]].first_child = id;
+      }
+    }
+    num_active = num_kept;
+  }
+
+  free(active);
+  free(leader);
+}
 
 void __ompc_set_xbarrier_wait()
 {
+  /* the tasking support is in __ompc_xbarrier_task_wait */
+  __ompc_xbarrier_wait = &__ompc_xbarrier_task_wait;
+
   switch (__omp_xbarrier_type) {
     case DISSEM_XBARRIER:
-      __ompc_xbarrier_wait = &__ompc_xbarrier_dissem_wait;
+      __ompc_xbarrier_algorithm = &__ompc_xbarrier_dissem_wait;
+      /* symmetric, there is no arrival-only half */
+      __ompc_xbarrier_join = &__ompc_xbarrier_dissem_wait;
       break;
     case TOUR_XBARRIER:
-      __ompc_xbarrier_wait = &__ompc_xbarrier_tour_wait;
+      __ompc_xbarrier_algorithm = &__ompc_xbarrier_tour_wait;
+      __ompc_xbarrier_join = &__ompc_xbarrier_tour_join;
       break;
     case TREE_XBARRIER:
-      __ompc_xbarrier_wait = &__ompc_xbarrier_tree_wait;
+      /* a wider tree is shallower, which pays off once there are many
+       * threads to gather */
+      if (__omp_xbarrier_arrival_radix == 0)
+        __omp_xbarrier_arrival_radix = __omp_num_processors > 32 ? 8 : 4;
+      if (__omp_xbarrier_wakeup_radix == 0)
+        __omp_xbarrier_wakeup_radix = __omp_num_processors > 32 ? 8 :
+                                      __omp_num_processors > 8 ? 4 : 2;
+      __ompc_xbarrier_algorithm = &__ompc_xbarrier_tree_wait;
+      __ompc_xbarrier_join = &__ompc_xbarrier_tree_join;
       break;
     case SIMPLE_XBARRIER:
-      __ompc_xbarrier_wait = &__ompc_xbarrier_simple_wait;
+      __ompc_xbarrier_algorithm = &__ompc_xbarrier_simple_wait;
+      __ompc_xbarrier_join = &__ompc_xbarrier_simple_join;
+      break;
+    case HIER_XBARRIER:
+      hier_xbarrier_topology();
+      __ompc_xbarrier_algorithm = &__ompc_xbarrier_hier_wait;
+      __ompc_xbarrier_join = &__ompc_xbarrier_hier_join;
       break;
     default:
+      /* runs the tasks itself */
       __ompc_xbarrier_wait = &__ompc_barrier_wait;
+      __ompc_xbarrier_algorithm = NULL;
+      __ompc_xbarrier_join = NULL;
       break;
   }
 }
 
+/* Barrier of a team through the selected algorithm, which runs queued
+ * tasks while it waits. Once the algorithm completes, every thread has
+ * arrived, so only tasks can still create tasks, and the team is done
+ * as soon as one thread sees no task pending. That thread records the
+ * episode in xbarrier_drained, so that the others need not see the
+ * pool empty themselves: they could miss it because of tasks created
+ * after the barrier by a thread that has already left.
+ */
+void __ompc_xbarrier_task_wait(omp_team_t *team)
+{
+  omp_xbarrier_local_info_t *xbarrier_local;
+  omp_task_pool_t *pool = team->task_pool;
+  omp_task_t *current_task = __omp_current_task;
+  int episode;
+
+  if (team->team_size == 1)
+    return;
+
+  xbarrier_local = &(__omp_current_v_thread->xbarrier_local);
+  episode = ++xbarrier_local->episode;
+
+  __ompc_task_set_state(current_task, OMP_TASK_IN_BARRIER);
+
+  __ompc_xbarrier_algorithm(team);
+
+  if (pool != NULL) {
+    XBARRIER_WAIT_WHILE(team, __ompc_task_pool_num_pending_tasks(pool) &&
+                              team->xbarrier_drained != episode);
+    if (team->xbarrier_drained != episode) {
+      team->xbarrier_drained = episode;
+      __ompc_xbarrier_wake_all(team);
+    }
+  }
+
+  __ompc_task_set_state(current_task, OMP_TASK_RUNNING);
+}
+
 void __ompc_xbarrier_info_init(omp_team_t *team)
 {
   int i,j;
@@ -79,8 +306,12 @@ void __ompc_xbarrier_info_init(omp_team_t *team)
   log2_team_size = team->log2_team_size;
 
   info = &(team->xbarrier_info);
+  /* the local episodes and senses start over */
+  team->xbarrier_drained = 0;
+  team->champion_sense = False;
+  memset(team->reduction_slots, 0, sizeof(omp_reduction_slot_t) * team_size);
 
-  switch(__omp_xbarrier_type) {
+  switch(team->xbarrier_type) {
     case LINEAR_XBARRIER:
     case SIMPLE_XBARRIER:
       break;
@@ -96,6 +327,9 @@ void __ompc_xbarrier_info_init(omp_team_t *team)
     case TREE_XBARRIER:
       memset(info->shared_array, 0, sizeof(omp_treenode_t) * team_size);
       break;
+    case HIER_XBARRIER:
+      hier_xbarrier_build(info->hier_nodes, team_size);
+      break;
     case DISSEM_XBARRIER:
       if (team_size == 1) {
         info->nodes = NULL;
@@ -125,8 +359,18 @@ void __ompc_xbarrier_info_create(omp_team_t *team)
   log2_team_size = team->log2_team_size;
 
   info = &(team->xbarrier_info);
-
-  switch(__omp_xbarrier_type) {
+  team->xbarrier_type = __omp_xbarrier_type;
+  /* the local episodes and senses start over */
+  team->xbarrier_drained = 0;
+  team->champion_sense = False;
+
+  team->reduction_slots = (omp_reduction_slot_t *)
+    aligned_malloc(sizeof(omp_reduction_slot_t) * team_size, CACHE_LINE_SIZE);
+  Is_True(team->reduction_slots != NULL,
+          ("Can't allocate reduction tree"));
+  memset(team->reduction_slots, 0, sizeof(omp_reduction_slot_t) * team_size);
+
+  switch(team->xbarrier_type) {
     case LINEAR_XBARRIER:
     case SIMPLE_XBARRIER:
       break;
@@ -150,6 +394,14 @@ void __ompc_xbarrier_info_create(omp_team_t *team)
                                     CACHE_LINE_SIZE );
       memset(info->shared_array, 0, sizeof(omp_treenode_t) * team_size);
       break;
+    case HIER_XBARRIER:
+      info->hier_nodes =
+        (omp_hiernode_t *) aligned_malloc(sizeof(omp_hiernode_t) * team_size,
+                                          CACHE_LINE_SIZE);
+      Is_True(info->hier_nodes != NULL,
+              ("Can't allocate hierarchical barrier tree"));
+      hier_xbarrier_build(info->hier_nodes, team_size);
+      break;
     case DISSEM_XBARRIER:
       if (team_size == 1) {
         info->nodes = NULL;
@@ -186,7 +438,10 @@ void __ompc_xbarrier_info_destroy(omp_team_t *team)
   team_size = team->team_size;
   info = team->xbarrier_info;
 
-  switch(__omp_xbarrier_type) {
+  aligned_free(team->reduction_slots);
+  team->reduction_slots = NULL;
+
+  switch(team->xbarrier_type) {
     case LINEAR_XBARRIER:
     case SIMPLE_XBARRIER:
       break;
@@ -201,6 +456,9 @@ void __ompc_xbarrier_info_destroy(omp_team_t *team)
     case TREE_XBARRIER:
       aligned_free(info.shared_array);
       break;
+    case HIER_XBARRIER:
+      aligned_free(info.hier_nodes);
+      break;
     case DISSEM_XBARRIER:
       if (team_size > 1) {
         for(i = 0; i < team_size; i++) {
@@ -212,6 +470,83 @@ void __ompc_xbarrier_info_destroy(omp_team_t *team)
   }
 }
 
+/* Reduction through a combining tree, which also synchronizes the team
+ * like a barrier, without running tasks. Each thread passes its partial
+ * result in data; a thread combines the results of its children into
+ * its own with combine, then hands it to its parent. Once it returns,
+ * data of thread 0 holds the result of the team, and so does data of
+ * every thread if broadcast is set: the release wave copies it down the
+ * tree, and a thread waits for its children to copy before it leaves.
+ */
+void __ompc_tree_reduction(int gtid, void *data, int size,
+                           void (*combine)(void *inout, void *in),
+                           int broadcast)
+{
+  omp_team_t *team;
+  omp_reduction_slot_t *slots, *myslot, *parentslot;
+  int thread_id, team_size, radix, child, last_child, episode;
+
+  __ompc_fuzzy_barrier_resolve();
+  if (__omp_exe_mode & OMP_EXE_MODE_SEQUENTIAL)
+    return;
+  if (__omp_exe_mode & OMP_EXE_MODE_NORMAL)
+    team = (omp_team_t *) &__omp_level_1_team_manager;
+  else
+    team = __omp_current_v_thread->team;
+
+  team_size = team->team_size;
+  if (team_size == 1)
+    return;
+
+  radix = __omp_xbarrier_arrival_radix > 0 ?
+          __omp_xbarrier_arrival_radix : OMP_REDUCTION_RADIX_DEFAULT;
+  thread_id = __omp_myid;
+  slots = team->reduction_slots;
+  myslot = &slots[thread_id];
+  episode = ++myslot->episode;
+
+  child = thread_id * radix + 1;
+  last_child = child + radix;
+  if (last_child > team_size)
+    last_child = team_size;
+
+  /* gather the subtrees below us, then report ours to the parent. A
+   * thread waits on one flag at a time, so its sleepers count covers
+   * them all. */
+  myslot->data = data;
+  for (; child < last_child; child++) {
+    __ompc_wait_eq(&slots[child].arrived, episode, &myslot->sleepers);
+    combine(data, slots[child].data);
+  }
+  __ompc_mfence();
+  myslot->arrived = episode;
+
+  if (thread_id != 0) {
+    parentslot = &slots[(thread_id - 1) / radix];
+    __ompc_wake(&myslot->arrived, &parentslot->sleepers);
+    __ompc_wait_eq(&myslot->release, episode, &myslot->sleepers);
+    if (broadcast) {
+      /* the parent has the result, and waits for us to copy it */
+      memcpy(data, parentslot->data, size);
+      __ompc_mfence();
+      myslot->copied = episode;
+      __ompc_wake(&myslot->copied, &parentslot->sleepers);
+    }
+  }
+
+  child = thread_id * radix + 1;
+  for (; child < last_child; child++) {
+    slots[child].release = episode;
+    __ompc_wake(&slots[child].release, &slots[child].sleepers);
+  }
+
+  if (broadcast) {
+    child = thread_id * radix + 1;
+    for (; child < last_child; child++)
+      __ompc_wait_eq(&slots[child].copied, episode, &myslot->sleepers);
+  }
+}
+
 void __ompc_init_xbarrier_local_info( omp_xbarrier_local_info_t *local,
                                       int vpid, omp_team_t *team)
 {
@@ -220,11 +555,14 @@ void __ompc_init_xbarrier_local_info( omp_xbarrier_local_info_t *local,
 
   local->parity = 0;
   local->sense = True;
+  local->episode = 0;
 
   if (__omp_xbarrier_type == TREE_XBARRIER) {
      tree_xbarrier_init(vpid, &(local->u.mynode), team);
   } else if (__omp_xbarrier_type == TOUR_XBARRIER) {
      tour_xbarrier_init(vpid, &(local->u.myrounds), team);
+  } else if (__omp_xbarrier_type == HIER_XBARRIER) {
+     hier_xbarrier_init(vpid, &(local->u.myhiernode), team);
   }
 }
 
@@ -233,6 +571,7 @@ void __ompc_init_xbarrier_local_info( omp_xbarrier_local_info_t *local,
 void tree_xbarrier_init(int vpid, omp_treenode_t **mynode, omp_team_t *team)
 {
   int i,child_id;
+  int arrival_radix, wakeup_radix;
   int team_size;
   omp_xbarrier_info_t team_xbarrier_info;
 
@@ -243,28 +582,44 @@ void tree_xbarrier_init(int vpid, omp_treenode_t **mynode, omp_team_t *team)
 
   *mynode = &(team_xbarrier_info.shared_array[vpid]);
 
+  arrival_radix = __omp_xbarrier_arrival_radix;
+  wakeup_radix = __omp_xbarrier_wakeup_radix;
+
   if (vpid == 0) {
     (*mynode)->parentflag = &(*mynode)->dummy;
+    (*mynode)->parentword = NULL;
+    (*mynode)->parent_sleepers = NULL;
   } else {
-    int parentid = (vpid -1)/4;
-    int my_index = vpid - (parentid * 4) - 1;
-    (*mynode)->parentflag =
-      &(team_xbarrier_info.shared_array[parentid].childnotready.parts[my_index]);
+    int parentid = (vpid - 1) / arrival_radix;
+    int my_index = vpid - (parentid * arrival_radix) - 1;
+    omp_treenode_t *parent = &team_xbarrier_info.shared_array[parentid];
+    (*mynode)->parentflag = &parent->childnotready.parts[my_index];
+    (*mynode)->parentword =
+      &parent->childnotready.halves[my_index / sizeof(int)];
+    (*mynode)->parent_sleepers = &parent->sleepers;
   }
 
-  for (i = 0, child_id = 2*vpid+1; i < 2; i++, child_id++) {
-    if (team_size > child_id)  /* have child i in wakeup tree */
-      (*mynode)->child_notify[i] =
-        &(team_xbarrier_info.shared_array[child_id].wakeup_sense);
-    else  /* don't have child i in wakeup tree */
-      (*mynode)->child_notify[i] = &(*mynode)->dummy;
+  (*mynode)->num_wakeup_children = 0;
+  for (i = 0, child_id = wakeup_radix*vpid+1;
+       i < wakeup_radix && child_id < team_size; i++, child_id++) {
+    /* have child i in wakeup tree */
+    (*mynode)->child_notify[i] =
+      &(team_xbarrier_info.shared_array[child_id].wakeup_sense);
+    (*mynode)->num_wakeup_children++;
   }
-  for(i = 0, child_id = 4*vpid+1; i < 4; i++, child_id++) {
+  (*mynode)->havechild.whole = 0;
+  for(i = 0, child_id = arrival_radix*vpid+1; i < arrival_radix;
+      i++, child_id++) {
          /* have child i in arrival tree */
     (*mynode)->havechild.parts[i] = (team_size > child_id);
-    (*mynode)->childnotready.whole = (*mynode)->havechild.whole;
-    (*mynode)->wakeup_sense = False;
   }
+  (*mynode)->childnotready.whole = (*mynode)->havechild.whole;
+  (*mynode)->wakeup_sense = False;
+}
+
+void hier_xbarrier_init(int vpid, omp_hiernode_t **mynode, omp_team_t *team)
+{
+  *mynode = &(team->xbarrier_info.hier_nodes[vpid]);
 }
 
 void tour_xbarrier_init(int vpid, omp_round_t **myrounds, omp_team_t *team)
@@ -290,12 +645,15 @@ void tour_xbarrier_init(int vpid, omp_round_t **myrounds, omp_team_t *team)
         int partner = vpid + (1 << k);
         if (partner < team_size) (*myrounds)[k].role = WINNER;
         else (*myrounds)[k].role = NOOP;
-        (*myrounds)[k].opponent = (boolean *) NULL;
+        (*myrounds)[k].opponent = (int *) NULL;
+        (*myrounds)[k].opponent_sleepers = (int *) NULL;
      }
      else if (vpid_mod_2_sup_k_plus_1 == (1 << k)) {
         (*myrounds)[k].role = LOSER;
         (*myrounds)[k].opponent =
           &(team_xbarrier_info.rounds[vpid - (1<<k)][k].flag);
+        (*myrounds)[k].opponent_sleepers =
+          &(team_xbarrier_info.rounds[vpid - (1<<k)][k].sleepers);
          break;
      }
   }
@@ -324,11 +682,10 @@ void __ompc_xbarrier_simple_wait(omp_team_t *team)
     /* The last one reset flags*/
     team->barrier_count = 0;
     team->barrier_flag = barrier_flag ^ 1; /* Xor: toggle*/
+    __ompc_xbarrier_wake_all(team);
   }
   else {
-    while (team->barrier_flag == barrier_flag) {
-      /* keep checking */
-    }
+    XBARRIER_WAIT_WHILE(team, team->barrier_flag == barrier_flag);
   }
 }
 
@@ -351,10 +708,10 @@ void __ompc_xbarrier_dissem_wait(omp_team_t *team)
   for (r = 0; r < log2_team_size; r++) {
     nodes[thread_id][r].partner->flag[xbarrier_local->parity] =
       xbarrier_local->sense;
-    while (nodes[thread_id][r].flag[xbarrier_local->parity] !=
-           xbarrier_local->sense) {
-      /* keep checking */
-    }
+    /* the partner is thread_id + d, and only it waits on its flag */
+    __ompc_xbarrier_wake(team, (thread_id + d) % team->team_size);
+    XBARRIER_WAIT_WHILE(team, nodes[thread_id][r].flag[xbarrier_local->parity] !=
+                    xbarrier_local->sense);
     d = 2*d;
   }
 
@@ -363,8 +720,6 @@ void __ompc_xbarrier_dissem_wait(omp_team_t *team)
   xbarrier_local->parity = 1 - xbarrier_local->parity;
 }
 
-volatile boolean champion_sense = False;
-
 void __ompc_xbarrier_tour_wait(omp_team_t *team)
 {
   int thread_id;
@@ -381,21 +736,19 @@ void __ompc_xbarrier_tour_wait(omp_team_t *team)
   for(;;) {
      if(round->role & LOSER) {
        *(round->opponent) = xbarrier_local->sense;
-       while (champion_sense != xbarrier_local->sense) {
-         /* keep checking */
-       }
+       /* the opponent of round k is thread_id - 2^k */
+       __ompc_xbarrier_wake(team,
+           thread_id - (1 << (round - xbarrier_local->u.myrounds)));
+       XBARRIER_WAIT_WHILE(team, team->champion_sense != xbarrier_local->sense);
        break;
      }
      else if(round->role & WINNER) {
-       while (round->flag != xbarrier_local->sense) {
-         /* keep checking */
-       }
+       XBARRIER_WAIT_WHILE(team, round->flag != xbarrier_local->sense);
        /* continue */
      } else if (round->role & CHAMPION) {
-       while (round->flag != xbarrier_local->sense) {
-         /* keep checking */
-       }
-       champion_sense = xbarrier_local->sense;
+       XBARRIER_WAIT_WHILE(team, round->flag != xbarrier_local->sense);
+       team->champion_sense = xbarrier_local->sense;
+       __ompc_xbarrier_wake_all(team);
        break;
      }
      round++;
@@ -405,7 +758,7 @@ void __ompc_xbarrier_tour_wait(omp_team_t *team)
 
 void __ompc_xbarrier_tree_wait(omp_team_t *team)
 {
-  int thread_id;
+  int thread_id, i;
   omp_xbarrier_local_info_t *xbarrier_local;
   omp_treenode_t *mynode_reg;
 
@@ -416,21 +769,170 @@ void __ompc_xbarrier_tree_wait(omp_team_t *team)
   xbarrier_local = &(__omp_current_v_thread->xbarrier_local);
   mynode_reg = xbarrier_local->u.mynode;
 
-  while (mynode_reg->childnotready.whole) {
-    /* keep checking */
-  }
+  XBARRIER_WAIT_WHILE(team, mynode_reg->childnotready.whole);
 
   mynode_reg->childnotready.whole = mynode_reg->havechild.whole;
   *(mynode_reg->parentflag) = False;
+  if (thread_id != 0) {
+    __ompc_xbarrier_wake(team, (thread_id - 1) / __omp_xbarrier_arrival_radix);
+    XBARRIER_WAIT_WHILE(team, mynode_reg->wakeup_sense != xbarrier_local->sense);
+  }
 
-  if (thread_id != 0)
-      while (mynode_reg->wakeup_sense != xbarrier_local->sense) {
-        /* keep checking */
-      }
+  for (i = 0; i < mynode_reg->num_wakeup_children; i++) {
+    *mynode_reg->child_notify[i] = xbarrier_local->sense;
+    __ompc_xbarrier_wake(team, __omp_xbarrier_wakeup_radix * thread_id + 1 + i);
+  }
+  xbarrier_local->sense ^= True;
+}
+
+void __ompc_xbarrier_hier_wait(omp_team_t *team)
+{
+  omp_xbarrier_local_info_t *xbarrier_local;
+  omp_hiernode_t *nodes, *mynode_reg;
+  int episode, child;
+
+  if (team->team_size == 1)
+    return;
+
+  xbarrier_local = &(__omp_current_v_thread->xbarrier_local);
+  mynode_reg = xbarrier_local->u.myhiernode;
+  nodes = team->xbarrier_info.hier_nodes;
+  /* counted by __ompc_xbarrier_task_wait */
+  episode = xbarrier_local->episode;
+
+  /* gather the subtrees below us, then report ours to the parent */
+  for (child = mynode_reg->first_child; child >= 0;
+       child = nodes[child].next_sibling)
+    XBARRIER_WAIT_WHILE(team, nodes[child].arrived != episode);
+
+  if (mynode_reg->parent >= 0) {
+    mynode_reg->arrived = episode;
+    __ompc_xbarrier_wake(team, mynode_reg->parent);
+    XBARRIER_WAIT_WHILE(team, mynode_reg->release != episode);
+  }
+
+  for (child = mynode_reg->first_child; child >= 0;
+       child = nodes[child].next_sibling) {
+    nodes[child].release = episode;
+    __ompc_xbarrier_wake(team, child);
+  }
+}
+
+/* Arrival-only halves, used for the join at the end of a level-1
+ * region. Only the master (thread 0) waits for the whole team; the
+ * other threads leave as soon as they have signalled, and are released
+ * again by the next fork. Each thread updates its own barrier state,
+ * and reads what it needs for the wake, before it signals, since the
+ * master may reinitialize the team once everyone has arrived. The
+ * tasks are done by now, so a waiter parks on the flag itself, through
+ * __ompc_wait_eq, rather than in the idle registry.
+ */
+
+void __ompc_xbarrier_simple_join(omp_team_t *team)
+{
+  int team_size = team->team_size;
+
+  if (team_size == 1)
+    return;
+
+  if (__ompc_atomic_inc(&team->barrier_count) == team_size)
+    __ompc_wake(&team->barrier_count, &team->barrier_sleepers);
+
+  if (__omp_myid == 0) {
+    __ompc_wait_eq(&team->barrier_count, team_size, &team->barrier_sleepers);
+    team->barrier_count = 0;
+  }
+}
+
+void __ompc_xbarrier_tour_join(omp_team_t *team)
+{
+  omp_xbarrier_local_info_t *xbarrier_local;
+  omp_round_t *round;
+  boolean sense;
 
-  *mynode_reg->child_notify[0] = xbarrier_local->sense;
-  *mynode_reg->child_notify[1] = xbarrier_local->sense;
+  if (team->team_size == 1)
+    return;
+
+  xbarrier_local = &(__omp_current_v_thread->xbarrier_local);
+  round = xbarrier_local->u.myrounds;
+  sense = xbarrier_local->sense;
   xbarrier_local->sense ^= True;
+
+  for(;;) {
+     if(round->role & LOSER) {
+       volatile int *opponent = round->opponent;
+       volatile int *opponent_sleepers = round->opponent_sleepers;
+       *opponent = sense;
+       __ompc_wake(opponent, opponent_sleepers);
+       break;
+     }
+     else if(round->role & WINNER) {
+       __ompc_wait_eq(&round->flag, sense, &round->sleepers);
+       /* continue */
+     } else if (round->role & CHAMPION) {
+       __ompc_wait_eq(&round->flag, sense, &round->sleepers);
+       team->champion_sense = sense;
+       break;
+     }
+     round++;
+  }
+}
+
+void __ompc_xbarrier_tree_join(omp_team_t *team)
+{
+  omp_xbarrier_local_info_t *xbarrier_local;
+  omp_treenode_t *mynode_reg;
+  volatile int *parentword, *parent_sleepers;
+  boolean sense;
+
+  if (team->team_size == 1)
+    return;
+
+  xbarrier_local = &(__omp_current_v_thread->xbarrier_local);
+  mynode_reg = xbarrier_local->u.mynode;
+  sense = xbarrier_local->sense;
+
+  __ompc_wait_eq(&mynode_reg->childnotready.halves[0], 0,
+                 &mynode_reg->sleepers);
+  __ompc_wait_eq(&mynode_reg->childnotready.halves[1], 0,
+                 &mynode_reg->sleepers);
+
+  mynode_reg->childnotready.whole = mynode_reg->havechild.whole;
+  /* nobody wakes us up this time, the next fork does */
+  mynode_reg->wakeup_sense = sense;
+  xbarrier_local->sense ^= True;
+  parentword = mynode_reg->parentword;
+  parent_sleepers = mynode_reg->parent_sleepers;
+
+  *(mynode_reg->parentflag) = False;
+  if (parentword != NULL)
+    __ompc_wake(parentword, parent_sleepers);
+}
+
+void __ompc_xbarrier_hier_join(omp_team_t *team)
+{
+  omp_xbarrier_local_info_t *xbarrier_local;
+  omp_hiernode_t *nodes, *mynode_reg;
+  int episode, child, parent;
+
+  if (team->team_size == 1)
+    return;
+
+  xbarrier_local = &(__omp_current_v_thread->xbarrier_local);
+  mynode_reg = xbarrier_local->u.myhiernode;
+  nodes = team->xbarrier_info.hier_nodes;
+  episode = ++xbarrier_local->episode;
+
+  for (child = mynode_reg->first_child; child >= 0;
+       child = nodes[child].next_sibling)
+    __ompc_wait_eq(&nodes[child].arrived, episode, &mynode_reg->sleepers);
+
+  /* the next fork releases us */
+  parent = mynode_reg->parent;
+  if (parent >= 0) {
+    mynode_reg->arrived = episode;
+    __ompc_wake(&mynode_reg->arrived, &nodes[parent].sleepers);
+  }
 }
 
 #if 0
@@ -50,7 +50,8 @@ typedef enum {
   SIMPLE_XBARRIER,
   TOUR_XBARRIER,
   TREE_XBARRIER,
-  DISSEM_XBARRIER
+  DISSEM_XBARRIER,
+  HIER_XBARRIER
 } omp_xbarrier_t;
 
 /* dissemination barrier */
@@ -60,50 +61,100 @@ struct localnode {
 } __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
 typedef struct localnode omp_localnode_t;
 
-/* tree barrier */
+/* tree barrier: each child in the arrival tree owns one byte of a
+ * 64-bit word of its parent, so that the parent polls a single word */
+#define OMP_XBARRIER_MAX_ARRIVAL_RADIX	8
+#define OMP_XBARRIER_MAX_WAKEUP_RADIX	16
+
 typedef union {
-  volatile long whole;
-  boolean parts[4];
+  volatile unsigned long long whole;
+  boolean parts[OMP_XBARRIER_MAX_ARRIVAL_RADIX];
+  volatile int halves[2];       /* futex words, for the join */
 } whole_and_parts;
 
 struct treenode {
-  volatile boolean *parentflag;
-  volatile boolean *child_notify[2];
   whole_and_parts havechild;
   whole_and_parts childnotready;
+  volatile boolean *parentflag;
+  volatile int *parentword;     /* half of the parent holding parentflag */
+  volatile int *parent_sleepers;
+  volatile int sleepers;        /* parked on our childnotready, join only */
   volatile boolean wakeup_sense;
   boolean dummy;
-  int pad[4];
+  int num_wakeup_children;
+  volatile boolean *child_notify[OMP_XBARRIER_MAX_WAKEUP_RADIX];
 } __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
 typedef struct treenode omp_treenode_t;
 
 /* tournament barrier */
 struct round_t {
-  volatile boolean *opponent;
+  volatile int *opponent;
+  volatile int *opponent_sleepers;
   role_enum role;
-  volatile boolean flag;
+  volatile int flag;
+  volatile int sleepers;        /* parked on flag, join only */
 } __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
 typedef struct round_t omp_round_t;
 
+/* hierarchical barrier: a combining tree following the machine
+ * topology, children are linked through next_sibling */
+struct hiernode {
+  volatile int arrived;         /* last episode this subtree arrived at */
+  int parent;
+  int first_child;
+  int next_sibling;
+  volatile int sleepers;        /* parked on a child, join only */
+  volatile int release          /* last episode released to this thread */
+    __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+} __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+typedef struct hiernode omp_hiernode_t;
+
+/* tree reduction: the slot of a thread in the combining tree of
+ * __ompc_tree_reduction, the fields are last episodes */
+struct reduction_slot {
+  void * volatile data;         /* partial result of the subtree */
+  volatile int arrived;         /* data holds the subtree result */
+  volatile int copied;          /* the broadcast result was copied */
+  int episode;                  /* reductions of the owner */
+  volatile int sleepers;        /* owner parked on a flag, see
+                                   __ompc_wait_eq */
+  volatile int release          /* the reduction is done */
+    __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+} __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
+typedef struct reduction_slot omp_reduction_slot_t;
+
+/* fan-in of the reduction tree unless O64_OMP_XBARRIER_RADIX is set */
+#define OMP_REDUCTION_RADIX_DEFAULT	4
+
 typedef union {
   omp_localnode_t **nodes;      /* dissemination barrier shared data */
   omp_treenode_t *shared_array;  /* tree barrier shared data */
   omp_round_t **rounds;       /* tournament barrier shared data */
+  omp_hiernode_t *hier_nodes;  /* hierarchical barrier shared data */
 } omp_xbarrier_info_t;
 
 
 struct omp_xbarrier_local_info {
   volatile int parity;             /* any barrier */
   volatile boolean sense;          /* any barrier */
+  int episode;                     /* any barrier, counts the waits */
   union {
   omp_treenode_t *mynode;     /* tree barrier */
   omp_round_t  *myrounds;   /* tournament barrier */
+  omp_hiernode_t *myhiernode; /* hierarchical barrier */
   } u;
 }; // __attribute__ ((__aligned__(CACHE_LINE_SIZE)));
 typedef struct omp_xbarrier_local_info omp_xbarrier_local_info_t;
 
 /* global variables extern declarations */
 extern omp_xbarrier_t __omp_xbarrier_type;
+/* O64_OMP_XBARRIER_TYPE=auto: __omp_xbarrier_type is picked by timing
+ * every algorithm at the size of the level-1 team */
+extern int __omp_xbarrier_auto;
+/* fan-in and fan-out of the tree barrier, set by O64_OMP_XBARRIER_RADIX
+ * or picked from the number of processors when 0 */
+extern int __omp_xbarrier_arrival_radix;
+extern int __omp_xbarrier_wakeup_radix;
 extern long int __omp_spin_count; // defined in omp_thread.c
 
 extern void __ompc_set_xbarrier_wait();
@@ -186,6 +186,13 @@ void __ompt_event_callback(ompt_event_t event) {
 	if(__ompt_track_monitoring == 0)
 		return;
 
+	/* the thread and idle events are kept, so that a tool sees every
+	 * thread in a consistent state after an internal region */
+	if(__omp_internal_region && event != ompt_event_thread_begin &&
+	   event != ompt_event_thread_end && event != ompt_event_idle_begin &&
+	   event != ompt_event_idle_end)
+		return;
+
 	if(event > ompt_event_flush || ompt_callback_list[event] == NULL)
 		return;
 
@@ -56,7 +56,7 @@ omp_task_pool_t * __ompc_create_task_pool_simple_2level(int team_size)
   new_pool->level = aligned_malloc(sizeof(omp_task_queue_level_t)*2,
                                    CACHE_LINE_SIZE);
   pthread_mutex_init(&(new_pool->pool_lock), NULL);
-  pthread_cond_init(&(new_pool->pool_cond), NULL);
+  __ompc_task_pool_idle_create(new_pool, team_size);
 
   Is_True(new_pool->level != NULL,
       ("__ompc_create_task_pool: couldn't malloc level"));
@@ -118,6 +118,8 @@ omp_task_pool_t * __ompc_expand_task_pool_simple_2level(omp_task_pool_t *pool, i
     __ompc_queue_init(&per_thread->task_queue[i],
                       __omp_task_queue_num_slots);
 
+  __ompc_task_pool_idle_expand(pool, new_team_size);
+
   return pool;
 }
 
@@ -143,11 +145,7 @@ int __ompc_add_task_to_pool_simple_2level(omp_task_pool_t *pool, omp_task_t *tas
   /* num_pending_tasks track not just tasks entered into the task pool, but
    * also tasks marked as deferred that could not fit into the task pool
    */
-  if (__ompc_atomic_inc(&pool->num_pending_tasks) == 1) {
-    pthread_mutex_lock(&pool->pool_lock);
-    pthread_cond_broadcast(&pool->pool_cond);
-    pthread_mutex_unlock(&pool->pool_lock);
-  }
+  __ompc_atomic_inc(&pool->num_pending_tasks);
 
   /* don't try to place it in per-thread queue if it looks to be full, because
    * we have the community queue to use instead   */
@@ -158,6 +156,10 @@ int __ompc_add_task_to_pool_simple_2level(omp_task_pool_t *pool, omp_task_t *tas
   if (!success)
     success = __ompc_task_queue_donate(pool->level[COMMUNITY].task_queue, task);
 
+  /* one queued task, one sleeper */
+  if (success)
+    __ompc_task_pool_wake_idle(pool);
+
   return success;
 }
 
@@ -257,6 +259,7 @@ void __ompc_destroy_task_pool_simple_2level(omp_task_pool_t *pool)
   __ompc_queue_free_slots(community->task_queue);
 
   pthread_mutex_destroy(&pool->pool_lock);
+  __ompc_task_pool_idle_destroy(pool);
 
   aligned_free(per_thread->task_queue); /* free queues in level 0 */
   aligned_free(community->task_queue); /* free queues in level 1 */